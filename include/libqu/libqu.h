@@ -127,6 +127,24 @@ typedef struct qu_vec2i
 
 /**
  * \brief Initialization parameters.
+ *
+ * If `bake_transforms` is set, transformations made with qu_translate(),
+ * qu_rotate() etc. are applied to vertices on CPU when they are drawn.
+ * This way draws made with different transformations can be batched
+ * together, which is usually faster when a lot of small objects are
+ * drawn with their own transformation.
+ *
+ * If `render_thread` is set, OpenGL commands are executed on a separate
+ * thread: while it renders the previous frame, the calling thread is free
+ * to record the next one. qu_present() waits until the previous frame is
+ * done. Calls that create or modify textures and surfaces block until the
+ * render thread is idle. This option is ignored on platforms that can't
+ * move the OpenGL context between threads.
+ *
+ * If `shader_cache_path` is set, compiled shader programs are saved to
+ * this file and reused on next launches with the same graphics driver,
+ * if it supports program binaries. The file is rewritten whenever it
+ * doesn't match the driver or shaders.
  */
 typedef struct qu_params
 {
@@ -139,6 +157,11 @@ typedef struct qu_params
     bool canvas_smooth;
     int canvas_width;
     int canvas_height;
+
+    bool bake_transforms;
+    bool render_thread;
+
+    char const *shader_cache_path;
 } qu_params;
 
 /**
@@ -659,6 +682,21 @@ typedef struct qu_texture
     int32_t id;
 } qu_texture;
 
+/**
+ * \brief Texture filtering mode.
+ *
+ * `QU_TEXTURE_FILTER_MIPMAP` samples pre-scaled copies of the texture
+ * when it's drawn smaller than its size, which looks better and is
+ * faster for heavily downscaled textures. Mipmaps take a third more
+ * of video memory.
+ */
+typedef enum qu_texture_filter
+{
+    QU_TEXTURE_FILTER_NEAREST,      //!< Nearest pixel, no smoothing.
+    QU_TEXTURE_FILTER_LINEAR,       //!< Bilinear filtering.
+    QU_TEXTURE_FILTER_MIPMAP,       //!< Trilinear filtering with mipmaps.
+} qu_texture_filter;
+
 /**
  * \brief Surface handle.
  */
@@ -675,6 +713,95 @@ typedef struct qu_font
     int32_t id;
 } qu_font;
 
+/**
+ * \brief Command list handle.
+ */
+typedef struct qu_command_list
+{
+    int32_t id;
+} qu_command_list;
+
+/**
+ * \brief Tilemap handle.
+ */
+typedef struct qu_tilemap
+{
+    int32_t id;
+} qu_tilemap;
+
+/**
+ * \brief Mesh handle.
+ */
+typedef struct qu_mesh
+{
+    int32_t id;
+} qu_mesh;
+
+/**
+ * \brief Particle system handle.
+ */
+typedef struct qu_particle_system
+{
+    int32_t id;
+} qu_particle_system;
+
+/**
+ * \brief Sprite description used by qu_draw_sprites().
+ *
+ * `x`, `y`, `w` and `h` define the destination rectangle, `rx`, `ry`, `rw`
+ * and `rh` define the source region of the texture in pixels.
+ * If `rw` or `rh` is zero, the whole texture is used.
+ * The sprite is rotated by `rotation` degrees around its center.
+ * `color` is multiplied with the texture, use 0xFFFFFFFF to draw the
+ * texture as is.
+ */
+typedef struct qu_sprite
+{
+    float x;
+    float y;
+    float w;
+    float h;
+    float rx;
+    float ry;
+    float rw;
+    float rh;
+    float rotation;
+    qu_color color;
+} qu_sprite;
+
+/**
+ * \brief Particle description used by qu_emit_particles().
+ *
+ * `x` and `y` define the center of the particle, `dx` and `dy` its
+ * velocity. The particle is a square `size` pixels wide, which grows by
+ * `growth` (or shrinks, if negative) per unit of time. The particle is
+ * removed when its `life` runs out or its size reaches zero.
+ */
+typedef struct qu_particle
+{
+    float x;
+    float y;
+    float dx;
+    float dy;
+    float life;
+    float size;
+    float growth;
+    qu_color color;
+} qu_particle;
+
+/**
+ * \brief Rendering statistics.
+ *
+ * `draw_commands` is the number of draw commands recorded during the frame,
+ * `draw_calls` is the number of draw calls actually issued to the GPU after
+ * compatible commands were merged into batches.
+ */
+typedef struct qu_render_stats
+{
+    int draw_commands;
+    int draw_calls;
+} qu_render_stats;
+
 /**
  * \brief Set the view parameters for rendering.
  *
@@ -703,6 +830,36 @@ QU_API void QU_CALL qu_translate(float x, float y);
 QU_API void QU_CALL qu_scale(float x, float y);
 QU_API void QU_CALL qu_rotate(float degrees);
 
+/**
+ * \brief Set the layer of subsequent draw calls.
+ *
+ * Draw calls on lower layers are rendered first. Calls on the same layer
+ * are rendered in the order they are made. Within the range of draw calls
+ * not separated by qu_clear(), surface, view or matrix functions, the
+ * renderer is free to group calls by layer, which lets calls interleaved
+ * in code (e.g. tiles and characters) be batched together when they are
+ * put on different layers. Enable `bake_transforms` in `qu_params` so
+ * that matrix functions don't separate draw calls.
+ *
+ * Layer is reset to 0 at the beginning of each frame.
+ *
+ * \param layer Layer of the following draw calls.
+ */
+QU_API void QU_CALL qu_set_layer(int layer);
+
+/**
+ * \brief Set width of shape outlines.
+ *
+ * Affects outlines drawn by qu_draw_triangle(), qu_draw_rectangle()
+ * and qu_draw_circle(). The outline is centered on the edge of the
+ * shape. Zero width disables outlines.
+ *
+ * Width is reset to 1 at the beginning of each frame.
+ *
+ * \param width Outline width in pixels.
+ */
+QU_API void QU_CALL qu_set_outline_width(float width);
+
 /**
  * \brief Clear the screen with a specified color.
  *
@@ -798,22 +955,359 @@ QU_API void QU_CALL qu_draw_circle(float x, float y, float radius,
  * \param path File path.
  */
 QU_API qu_texture QU_CALL qu_load_texture(char const *path);
+
+/**
+ * \brief Load texture from given path in background.
+ *
+ * Returns immediately, the image is decoded by worker threads and
+ * uploaded during one of the following calls to qu_present().
+ * Until then, the texture is drawn fully transparent, and stays so
+ * if the image fails to load.
+ *
+ * \param path File path.
+ * \return Texture handle, which can be used right away.
+ */
+QU_API qu_texture QU_CALL qu_load_texture_async(char const *path);
+
+/**
+ * \brief Check if texture has finished loading.
+ *
+ * If the image fails to load, the texture never becomes ready and keeps
+ * being drawn as a transparent placeholder.
+ *
+ * \param texture Texture handle.
+ * \return True if texture is loaded or was loaded synchronously,
+ *         false while it's loading or if loading failed.
+ */
+QU_API bool QU_CALL qu_is_texture_ready(qu_texture texture);
+
 QU_API void QU_CALL qu_delete_texture(qu_texture texture);
 QU_API void QU_CALL qu_set_texture_smooth(qu_texture texture, bool smooth);
+
+/**
+ * \brief Set filtering mode of the texture.
+ *
+ * Unlike qu_set_texture_smooth(), which only controls magnification,
+ * this sets filtering both when the texture is enlarged and when it's
+ * shrunk. Mipmaps are generated when needed and kept up to date.
+ *
+ * \param texture Texture handle.
+ * \param filter Filtering mode.
+ */
+QU_API void QU_CALL qu_set_texture_filter(qu_texture texture, qu_texture_filter filter);
 QU_API void QU_CALL qu_draw_texture(qu_texture texture, float x, float y, float w, float h);
+
+/**
+ * \brief Draw a region of the texture.
+ *
+ * Corners of the source region are clamped to the bounds of the
+ * texture, so the texture doesn't repeat: only the part of the region
+ * inside of the texture is drawn, stretched over the whole destination
+ * rectangle. Draw the texture multiple times to tile it.
+ *
+ * \param texture Texture handle.
+ * \param x X coordinate of the destination rectangle.
+ * \param y Y coordinate of the destination rectangle.
+ * \param w Width of the destination rectangle.
+ * \param h Height of the destination rectangle.
+ * \param rx X coordinate of the source region, in pixels.
+ * \param ry Y coordinate of the source region, in pixels.
+ * \param rw Width of the source region, in pixels.
+ * \param rh Height of the source region, in pixels.
+ */
 QU_API void QU_CALL qu_draw_subtexture(qu_texture texture, float x, float y, float w, float h, float rx, float ry, float rw, float rh);
 
+/**
+ * \brief Draw many sprites sharing the same texture at once.
+ *
+ * This is much faster than calling qu_draw_subtexture() for each sprite,
+ * all sprites are written into the vertex buffer in one pass and are
+ * drawn with a single draw call.
+ *
+ * \param texture Texture to draw sprites from.
+ * \param sprites Array of sprites.
+ * \param count Number of sprites in the array.
+ */
+QU_API void QU_CALL qu_draw_sprites(qu_texture texture, qu_sprite const *sprites, int count);
+
 QU_API qu_font QU_CALL qu_load_font(char const *path, float pt);
 QU_API void QU_CALL qu_delete_font(qu_font font);
 QU_API void QU_CALL qu_draw_text(qu_font font, float x, float y, qu_color color, char const *str);
 QU_API void QU_CALL qu_draw_text_fmt(qu_font font, float x, float y, qu_color color, char const *fmt, ...);
 
+/**
+ * \brief Create a surface to draw on.
+ *
+ * Surfaces have no depth buffer. Framebuffers of deleted surfaces are
+ * kept for reuse, so creating and deleting surfaces of the same size
+ * every frame is cheap.
+ *
+ * \param width Width of the surface.
+ * \param height Height of the surface.
+ * \return Surface handle.
+ */
 QU_API qu_surface QU_CALL qu_create_surface(int width, int height);
+
+/**
+ * \brief Create a surface with a depth buffer.
+ *
+ * Same as qu_create_surface(), but the surface gets a 16-bit depth
+ * attachment, which is cleared along with the color by qu_clear().
+ *
+ * \param width Width of the surface.
+ * \param height Height of the surface.
+ * \return Surface handle.
+ */
+QU_API qu_surface QU_CALL qu_create_surface_with_depth(int width, int height);
+
 QU_API void QU_CALL qu_delete_surface(qu_surface surface);
+
+/**
+ * \brief Change size of a surface.
+ *
+ * Storage of the surface is reallocated in place, the handle stays
+ * valid. Contents of the surface are lost.
+ *
+ * \param surface Surface to resize.
+ * \param width New width of the surface.
+ * \param height New height of the surface.
+ */
+QU_API void QU_CALL qu_resize_surface(qu_surface surface, int width, int height);
+
 QU_API void QU_CALL qu_set_surface(qu_surface surface);
 QU_API void QU_CALL qu_reset_surface(void);
 QU_API void QU_CALL qu_draw_surface(qu_surface surface, float x, float y, float w, float h);
 
+/**
+ * \brief Create an empty command list.
+ *
+ * Command lists let other threads record drawing in parallel with the
+ * main thread. Lists should be created and deleted on the main thread,
+ * and not while any list is being recorded.
+ *
+ * \return Handle of the new command list.
+ */
+QU_API qu_command_list QU_CALL qu_create_command_list(void);
+
+/**
+ * \brief Delete command list.
+ *
+ * \param list Command list to delete.
+ */
+QU_API void QU_CALL qu_delete_command_list(qu_command_list list);
+
+/**
+ * \brief Start recording a command list on the calling thread.
+ *
+ * Previous contents of the list are discarded. Until qu_end_command_list()
+ * is called, drawing, transformation, layer, view and surface switching
+ * functions called on this thread are recorded into the list instead of
+ * the frame. Functions that create or modify textures, surfaces and fonts
+ * (including qu_draw_text()) must not be called while recording.
+ *
+ * Layer of the list starts at 0. Lists should undo transformations they
+ * make with qu_push_matrix() and qu_pop_matrix().
+ *
+ * Each thread can record one list at a time, and a list can be recorded
+ * by only one thread at a time.
+ *
+ * \param list Command list to record.
+ */
+QU_API void QU_CALL qu_begin_command_list(qu_command_list list);
+
+/**
+ * \brief Stop recording the command list of the calling thread.
+ */
+QU_API void QU_CALL qu_end_command_list(void);
+
+/**
+ * \brief Draw contents of a command list.
+ *
+ * Contents of the list are inserted into the frame at this point when
+ * qu_present() is called, so lists drawn in the same order always
+ * produce the same image no matter which threads recorded them.
+ * Recording of the list must be finished before qu_present().
+ * A recorded list can be drawn any number of times, also in subsequent
+ * frames. Command lists can't draw other command lists.
+ *
+ * \param list Command list to draw.
+ */
+QU_API void QU_CALL qu_draw_command_list(qu_command_list list);
+
+/**
+ * \brief Create a tilemap.
+ *
+ * Tilemap is a grid of tiles taken from one tileset texture. It's kept
+ * in video memory in chunks of 32x32 tiles, and only chunks visible in
+ * the current view are drawn, so large static levels cost next to
+ * nothing per frame.
+ *
+ * Tiles of the tileset are numbered from 0, left to right and top to
+ * bottom. Negative tile indices leave the cell empty.
+ *
+ * \param tileset Tileset texture.
+ * \param tile_width Width of a tile in pixels.
+ * \param tile_height Height of a tile in pixels.
+ * \param columns Number of columns of the map.
+ * \param rows Number of rows of the map.
+ * \param tiles Row-major array of `columns * rows` tile indices,
+ *              or NULL to start with an empty map.
+ * \return Tilemap handle.
+ */
+QU_API qu_tilemap QU_CALL qu_create_tilemap(qu_texture tileset,
+                                            int tile_width, int tile_height,
+                                            int columns, int rows,
+                                            int const *tiles);
+
+/**
+ * \brief Delete a tilemap.
+ *
+ * \param tilemap Tilemap to delete.
+ */
+QU_API void QU_CALL qu_delete_tilemap(qu_tilemap tilemap);
+
+/**
+ * \brief Change one tile of a tilemap.
+ *
+ * Only the chunk containing the tile is rebuilt, the next time the
+ * tilemap is drawn.
+ *
+ * \param tilemap Tilemap to modify.
+ * \param column Column of the tile.
+ * \param row Row of the tile.
+ * \param tile Index of the tile in the tileset, negative to clear it.
+ */
+QU_API void QU_CALL qu_set_tile(qu_tilemap tilemap, int column, int row, int tile);
+
+/**
+ * \brief Draw a tilemap.
+ *
+ * Tilemap is affected by current transformation and layer.
+ *
+ * \param tilemap Tilemap to draw.
+ * \param x X coordinate of the top-left corner.
+ * \param y Y coordinate of the top-left corner.
+ */
+QU_API void QU_CALL qu_draw_tilemap(qu_tilemap tilemap, float x, float y);
+
+/**
+ * \brief Start capturing draw calls of the calling thread into a mesh.
+ *
+ * Until qu_end_mesh() is called, drawing and transformation functions
+ * are captured instead of being drawn. Other commands are dropped.
+ * Textures used in the mesh should be loaded beforehand: their atlas
+ * placement is captured as well.
+ *
+ * Meshes can't be started while a command list is being recorded.
+ */
+QU_API void QU_CALL qu_begin_mesh(void);
+
+/**
+ * \brief Finish capturing and create a mesh.
+ *
+ * Vertex data of the captured draw calls is uploaded to video memory
+ * once, so drawing the mesh later costs about as much as one draw call
+ * per texture and shape type used in it.
+ *
+ * \return Mesh handle.
+ */
+QU_API qu_mesh QU_CALL qu_end_mesh(void);
+
+/**
+ * \brief Delete a mesh.
+ *
+ * \param mesh Mesh to delete.
+ */
+QU_API void QU_CALL qu_delete_mesh(qu_mesh mesh);
+
+/**
+ * \brief Draw a mesh.
+ *
+ * Mesh is affected by current transformation and layer.
+ *
+ * \param mesh Mesh to draw.
+ * \param x X offset of the mesh.
+ * \param y Y offset of the mesh.
+ */
+QU_API void QU_CALL qu_draw_mesh(qu_mesh mesh, float x, float y);
+
+/**
+ * \brief Create a particle system.
+ *
+ * Particles of the system are updated together and drawn in one draw
+ * call, which is much faster than drawing them one by one.
+ *
+ * \param texture Texture of a particle, or zero handle to draw
+ *                untextured squares.
+ * \param capacity Maximum number of live particles.
+ * \return Particle system handle.
+ */
+QU_API qu_particle_system QU_CALL qu_create_particle_system(qu_texture texture,
+                                                            int capacity);
+
+/**
+ * \brief Delete a particle system.
+ *
+ * \param system Particle system to delete.
+ */
+QU_API void QU_CALL qu_delete_particle_system(qu_particle_system system);
+
+/**
+ * \brief Set acceleration applied to all particles of the system.
+ *
+ * \param system Particle system to modify.
+ * \param x Horizontal acceleration.
+ * \param y Vertical acceleration.
+ */
+QU_API void QU_CALL qu_set_particle_gravity(qu_particle_system system, float x, float y);
+
+/**
+ * \brief Add particles to a particle system.
+ *
+ * Particles that don't fit in the capacity of the system are dropped.
+ *
+ * \param system Particle system.
+ * \param particles Array of particles to add.
+ * \param count Number of particles in the array.
+ */
+QU_API void QU_CALL qu_emit_particles(qu_particle_system system,
+                                      qu_particle const *particles, int count);
+
+/**
+ * \brief Move particles and remove expired ones.
+ *
+ * \param system Particle system to update.
+ * \param dt Time step, in the same units as velocity and lifetime.
+ */
+QU_API void QU_CALL qu_update_particle_system(qu_particle_system system, float dt);
+
+/**
+ * \brief Get number of live particles.
+ *
+ * \param system Particle system.
+ * \return Number of live particles.
+ */
+QU_API int QU_CALL qu_get_particle_count(qu_particle_system system);
+
+/**
+ * \brief Draw all live particles of a particle system.
+ *
+ * Particles are affected by current transformation and layer.
+ *
+ * \param system Particle system to draw.
+ */
+QU_API void QU_CALL qu_draw_particle_system(qu_particle_system system);
+
+/**
+ * \brief Get rendering statistics of the last presented frame.
+ *
+ * The difference between `draw_commands` and `draw_calls` is the number of
+ * draw calls saved by batching.
+ *
+ * \return Statistics of the last frame.
+ */
+QU_API qu_render_stats QU_CALL qu_get_render_stats(void);
+
 /**@}*/
 
 //------------------------------------------------------------------------------
@@ -28,7 +28,7 @@
 
 #define TOTAL_ENEMIES           8
 #define TOTAL_BULLETS           4
-#define TOTAL_PARTICLES         256
+#define TOTAL_PARTICLES         1024
 #define TOTAL_POPUPS            2
 
 #define TEXTURE_CHARACTER       0
@@ -108,19 +108,6 @@ struct bullet
     qu_vec2f velocity;
 };
 
-struct particle
-{
-    bool active;
-
-    qu_vec2f position;
-    qu_vec2f velocity;
-    qu_vec2f size;
-    qu_color outline;
-    qu_color fill;
-
-    float start_time;
-};
-
 struct popup
 {
     struct scene *scene;
@@ -144,12 +131,11 @@ struct scene
     struct player player;
     struct enemy enemies[TOTAL_ENEMIES];
     struct bullet bullets[TOTAL_BULLETS];
-    struct particle particles[TOTAL_PARTICLES];
+    qu_particle_system particles;
     struct popup popups[TOTAL_POPUPS];
 
     float enemy_spawn_time;
     int current_bullet;
-    int current_particle;
     int current_popup;
 };
 
@@ -192,7 +178,7 @@ void scene_update(struct scene *scene);
 void scene_draw(struct scene *scene, double lag_offset);
 void scene_spawn_bullet(struct scene *scene, float x, float y, float dx, float dy);
 void scene_spawn_particle(struct scene *scene, float x, float y, float dx, float dy,
-    float w, float h, qu_color outline, qu_color fill);
+    float size, qu_color color);
 void scene_spawn_popup(struct scene *scene, float x, float y, float duration, int number);
 void scene_emit_blood(struct scene *scene, float x, float y, float dx, float dy);
 void scene_emit_splatter(struct scene *scene, float x, float y);
@@ -211,10 +197,6 @@ void bullet_init(struct bullet *bullet, struct scene *scene);
 void bullet_update(struct bullet *bullet);
 void bullet_draw(struct bullet *bullet, double lag_offset);
 
-void particle_init(struct particle *particle);
-void particle_update(struct particle *particle);
-void particle_draw(struct particle *particle, double lag_offset);
-
 void popup_init(struct popup *popup, struct scene *scene);
 void popup_update(struct popup *popup);
 void popup_draw(struct popup *popup);
@@ -397,11 +379,16 @@ void resources_init(struct resources *resources)
 
 void scene_init(struct scene *scene, struct game *game)
 {
+    qu_delete_particle_system(scene->particles);
+
     *scene = (struct scene) {
         .game = game,
         .enemy_spawn_time = qu_get_time_mediump() + 5.f,
+        .particles = qu_create_particle_system((qu_texture) { 0 }, TOTAL_PARTICLES),
     };
 
+    qu_set_particle_gravity(scene->particles, 0.f, 1.f);
+
     player_init(&scene->player, scene);
 }
 
@@ -435,11 +422,7 @@ void scene_update(struct scene *scene)
         }
     }
 
-    for (int i = 0; i < TOTAL_PARTICLES; i++) {
-        if (scene->particles[i].active) {
-            particle_update(&scene->particles[i]);
-        }
-    }
+    qu_update_particle_system(scene->particles, 1.f);
 
     for (int i = 0; i < TOTAL_POPUPS; i++) {
         if (scene->popups[i].active) {
@@ -467,11 +450,7 @@ void scene_draw(struct scene *scene, double lag_offset)
 
     player_draw(&scene->player, lag_offset);
 
-    for (int i = 0; i < TOTAL_PARTICLES; i++) {
-        if (scene->particles[i].active) {
-            particle_draw(&scene->particles[i], lag_offset);
-        }
-    }
+    qu_draw_particle_system(scene->particles);
 
     for (int i = 0; i < TOTAL_POPUPS; i++) {
         if (scene->popups[i].active) {
@@ -495,22 +474,20 @@ void scene_spawn_bullet(struct scene *scene, float x, float y, float dx, float d
 }
 
 void scene_spawn_particle(struct scene *scene, float x, float y, float dx, float dy,
-    float w, float h, qu_color outline, qu_color fill)
-{
-    struct particle *particle = &scene->particles[scene->current_particle];
-
-    particle_init(particle);
-
-    particle->position.x = x;
-    particle->position.y = y;
-    particle->velocity.x = dx;
-    particle->velocity.y = dy;
-    particle->size.x = w;
-    particle->size.y = h;
-    particle->outline = outline;
-    particle->fill = fill;
+    float size, qu_color color)
+{
+    qu_particle particle = {
+        .x = x + size * 0.5f,
+        .y = y + size * 0.5f,
+        .dx = dx,
+        .dy = dy,
+        .life = TICKS_PER_SECOND,
+        .size = size,
+        .growth = -0.33f,
+        .color = color,
+    };
 
-    scene->current_particle = (scene->current_particle + 1) % TOTAL_PARTICLES;
+    qu_emit_particles(scene->particles, &particle, 1);
 }
 
 void scene_spawn_popup(struct scene *scene, float x, float y, float duration,
@@ -534,8 +511,8 @@ void scene_emit_blood(struct scene *scene, float x, float y, float dx, float dy)
         float a = rand() % 24 - 12;
         float b = rand() % 24 - 12;
 
-        scene_spawn_particle(scene, x + a, y + b, dx + b, dy + a, 4.f, 4.f,
-            0, QU_COLOR(200 + rand() % 50, 0, 0));
+        scene_spawn_particle(scene, x + a, y + b, dx + b, dy + a, 4.f,
+            QU_COLOR(200 + rand() % 50, 0, 0));
     }
 }
 
@@ -549,8 +526,8 @@ void scene_emit_splatter(struct scene *scene, float x, float y)
         float dx = (rand() % 4) - 2.f;
         float dy = -(rand() % 16);
 
-        scene_spawn_particle(scene, x + a, y + b, dx, dy, c, c,
-            0, QU_COLOR(200 + rand() % 50, 0, 0));
+        scene_spawn_particle(scene, x + a, y + b, dx, dy, c,
+            QU_COLOR(200 + rand() % 50, 0, 0));
     }
 }
 
@@ -953,50 +930,6 @@ void bullet_draw(struct bullet *bullet, double lag_offset)
     qu_draw_rectangle(x, y, 8.f, 4.f, 0, 0xFFFFFF00);
 }
 
-//------------------------------------------------------------------------------
-// Particles
-
-void particle_init(struct particle *particle)
-{
-    *particle = (struct particle) {
-        .active = true,
-        .start_time = qu_get_time_mediump(),
-    };
-}
-
-void particle_update(struct particle *particle)
-{
-    particle->velocity.y += 1.f;
-
-    particle->position.x += particle->velocity.x;
-    particle->position.y += particle->velocity.y;
-
-    if (particle->position.x < -16.f || particle->position.x > 736.f) {
-        particle->active = false;
-    }
-
-    if (particle->position.y < -16.f || particle->position.y > 496.f) {
-        particle->active = false;
-    }
-
-    particle->size.x -= 0.33f;
-    particle->size.y -= 0.33f;
-
-    if (particle->size.x <= 0.f || particle->size.y <= 0.f) {
-        particle->active = false;
-    }
-}
-
-void particle_draw(struct particle *particle, double lag_offset)
-{
-    float x = particle->position.x + particle->velocity.x * lag_offset;
-    float y = particle->position.y + particle->velocity.y * lag_offset;
-
-    qu_draw_rectangle(x, y,
-        particle->size.x, particle->size.y,
-        particle->outline, particle->fill);
-}
-
 //------------------------------------------------------------------------------
 // Pop-ups
 
@@ -133,17 +133,44 @@ char const *libqu_file_repr(libqu_file *file);
 //------------------------------------------------------------------------------
 // Image loader
 
+#define LIBQU_MAX_IMAGE_LEVELS      (16)
+
+typedef enum
+{
+    LIBQU_COMPRESSION_NONE,
+    LIBQU_COMPRESSION_DXT1,
+    LIBQU_COMPRESSION_DXT1A,
+    LIBQU_COMPRESSION_DXT3,
+    LIBQU_COMPRESSION_DXT5,
+    LIBQU_COMPRESSION_ETC1,
+    LIBQU_COMPRESSION_ETC2,
+    LIBQU_COMPRESSION_ETC2_EAC,
+} libqu_compression;
+
+// Compressed images hold blocks of all mip levels one after another
+// in `pixels`, `channels` is 0 for them.
 typedef struct
 {
     int width;
     int height;
     int channels;
     unsigned char *pixels;
+
+    libqu_compression compression;
+    int level_count;
+    size_t level_sizes[LIBQU_MAX_IMAGE_LEVELS];
 } libqu_image;
 
 libqu_image *libqu_load_image(libqu_file *file);
 void libqu_delete_image(libqu_image *image);
 
+typedef struct libqu_image_job libqu_image_job;
+
+libqu_image_job *libqu_load_image_async(libqu_file *file);
+bool libqu_poll_image_job(libqu_image_job *job, libqu_image **image);
+void libqu_cancel_image_job(libqu_image_job *job);
+void libqu_terminate_image_loader(void);
+
 //------------------------------------------------------------------------------
 // Sound loader
 
@@ -164,8 +191,17 @@ void libqu_seek_sound(libqu_sound *sound, int64_t sample_offset);
 //------------------------------------------------------------------------------
 // Platform
 
+#if defined(_MSC_VER)
+#   define LIBQU_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__)
+#   define LIBQU_THREAD_LOCAL __thread
+#else
+#   define LIBQU_THREAD_LOCAL _Thread_local
+#endif
+
 typedef struct libqu_thread libqu_thread;
 typedef struct libqu_mutex libqu_mutex;
+typedef struct libqu_cond libqu_cond;
 typedef intptr_t(*libqu_thread_func)(void *);
 
 void libqu_platform_initialize(void);
@@ -183,7 +219,13 @@ void libqu_destroy_mutex(libqu_mutex *mutex);
 void libqu_lock_mutex(libqu_mutex *mutex);
 void libqu_unlock_mutex(libqu_mutex *mutex);
 
+libqu_cond *libqu_create_cond(void);
+void libqu_destroy_cond(libqu_cond *cond);
+void libqu_wait_cond(libqu_cond *cond, libqu_mutex *mutex);
+void libqu_signal_cond(libqu_cond *cond);
+
 void libqu_sleep(double seconds);
+int libqu_get_cpu_count(void);
 
 //------------------------------------------------------------------------------
 // Core
@@ -205,6 +247,7 @@ typedef struct
     libqu_gc(*get_gc)(void);
     bool (*gl_check_extension)(char const *name);
     void *(*gl_proc_address)(char const *name);
+    bool (*gl_make_current)(bool current);
 
     bool const *(*get_keyboard_state)(void);
     bool (*is_key_pressed)(qu_key key);
@@ -264,6 +307,9 @@ typedef struct
     void (*scale)(float x, float y);
     void (*rotate)(float degrees);
 
+    void (*set_layer)(int layer);
+    void (*set_outline_width)(float width);
+
     void (*clear)(qu_color color);
     void (*draw_point)(float x, float y, qu_color color);
     void (*draw_line)(float ax, float ay, float bx, float by, qu_color color);
@@ -278,21 +324,48 @@ typedef struct
     void (*update_texture)(int32_t texture_id, int x, int y, int w, int h,
                            uint8_t const *pixels);
     int32_t(*load_texture)(libqu_file *file);
+    int32_t(*load_texture_async)(libqu_file *file);
+    bool (*is_texture_ready)(int32_t texture_id);
     void (*delete_texture)(int32_t texture_id);
     void (*set_texture_smooth)(int32_t texture_id, bool smooth);
+    void (*set_texture_filter)(int32_t texture_id, qu_texture_filter filter);
     void (*draw_texture)(int32_t texture_id, float x, float y, float w,
                          float h);
     void (*draw_subtexture)(int32_t texture_id, float x, float y, float w,
                             float h, float rx, float ry, float rw, float rh);
+    void (*draw_sprites)(int32_t texture_id, qu_sprite const *sprites,
+                         int count);
+    void (*draw_particles)(int32_t texture_id, float const *x, float const *y,
+                           float const *size, qu_color const *color, int count);
 
     void (*draw_text)(int32_t texture_id, qu_color color, float const *data,
                       int count);
 
-    int32_t(*create_surface)(int width, int height);
+    int32_t(*create_surface)(int width, int height, bool depth);
     void (*delete_surface)(int32_t id);
+    void (*resize_surface)(int32_t id, int width, int height);
     void (*set_surface)(int32_t id);
     void (*reset_surface)(void);
     void (*draw_surface)(int32_t id, float x, float y, float w, float h);
+
+    int32_t (*create_command_list)(void);
+    void (*delete_command_list)(int32_t id);
+    void (*begin_command_list)(int32_t id);
+    void (*end_command_list)(void);
+    void (*draw_command_list)(int32_t id);
+
+    int32_t (*create_tilemap)(int32_t texture_id, int tile_width, int tile_height,
+                              int columns, int rows, int const *tiles);
+    void (*delete_tilemap)(int32_t id);
+    void (*set_tile)(int32_t id, int column, int row, int tile);
+    void (*draw_tilemap)(int32_t id, float x, float y);
+
+    void (*begin_mesh)(void);
+    int32_t (*end_mesh)(void);
+    void (*delete_mesh)(int32_t id);
+    void (*draw_mesh)(int32_t id, float x, float y);
+
+    qu_render_stats (*get_render_stats)(void);
 } libqu_graphics;
 
 void libqu_construct_null_graphics(libqu_graphics *graphics);
@@ -308,6 +381,19 @@ int32_t libqu_load_font(libqu_file *file, float pt);
 void libqu_delete_font(int32_t font_id);
 void libqu_draw_text(int32_t font_id, float x, float y, qu_color color, char const *text);
 
+//------------------------------------------------------------------------------
+// Particles
+
+void libqu_initialize_particles(libqu_graphics *graphics);
+void libqu_terminate_particles(void);
+int32_t libqu_create_particle_system(int32_t texture_id, int capacity);
+void libqu_delete_particle_system(int32_t id);
+void libqu_set_particle_gravity(int32_t id, float x, float y);
+void libqu_emit_particles(int32_t id, qu_particle const *particles, int count);
+void libqu_update_particle_system(int32_t id, float dt);
+int libqu_get_particle_count(int32_t id);
+void libqu_draw_particle_system(int32_t id);
+
 //------------------------------------------------------------------------------
 // Audio
 
@@ -342,6 +428,8 @@ void libqu_construct_openal_audio(libqu_audio *audio);
 
 bool libqu_gl_check_extension(char const *name);
 void *libqu_gl_proc_address(char const *name);
+bool libqu_gl_make_current(bool current);
+void libqu_gl_swap_buffers(void);
 void libqu_notify_gc_created(libqu_gc gc);
 void libqu_notify_gc_destroyed(void);
 void libqu_notify_display_resize(int width, int height);
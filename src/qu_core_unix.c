@@ -385,6 +385,11 @@ static void initialize(qu_params const *params)
 
     // (0) Open display
 
+    // Buffers may be swapped from the render thread.
+    if (params->render_thread) {
+        XInitThreads();
+    }
+
     impl.display = XOpenDisplay(NULL);
 
     if (!impl.display) {
@@ -778,6 +783,15 @@ static void *gl_proc_address(char const *name)
     return glXGetProcAddress((GLubyte const *) name);
 }
 
+static bool gl_make_current(bool current)
+{
+    if (current) {
+        return glXMakeContextCurrent(impl.display, impl.surface, impl.surface, impl.context);
+    }
+
+    return glXMakeContextCurrent(impl.display, None, None, NULL);
+}
+
 //------------------------------------------------------------------------------
 
 static bool const *get_keyboard_state(void)
@@ -1079,6 +1093,7 @@ void libqu_construct_unix_core(libqu_core *core)
         .get_gc = get_gc,
         .gl_check_extension = gl_check_extension,
         .gl_proc_address = gl_proc_address,
+        .gl_make_current = gl_make_current,
         .get_keyboard_state = get_keyboard_state,
         .is_key_pressed = is_key_pressed,
         .get_mouse_button_state = get_mouse_button_state,
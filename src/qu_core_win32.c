@@ -820,6 +820,11 @@ static void *gl_proc_address(char const *name)
     return (void *) wglGetProcAddress(name);
 }
 
+static bool gl_make_current(bool current)
+{
+    return wglMakeCurrent(dpy.dc, current ? dpy.rc : NULL);
+}
+
 //------------------------------------------------------------------------------
 
 static bool const *get_keyboard_state(void)
@@ -1071,6 +1076,7 @@ void libqu_construct_win32_core(libqu_core *core)
         .get_gc = get_gc,
         .gl_check_extension = gl_check_extension,
         .gl_proc_address = gl_proc_address,
+        .gl_make_current = gl_make_current,
         .get_keyboard_state = get_keyboard_state,
         .is_key_pressed = is_key_pressed,
         .get_mouse_button_state = get_mouse_button_state,
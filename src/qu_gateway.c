@@ -109,6 +109,7 @@ void qu_initialize(qu_params const *user_params)
 
     initialize_graphics(qu.core.get_gc());
     libqu_initialize_text(&qu.graphics);
+    libqu_initialize_particles(&qu.graphics);
 
     libqu_construct_openal_audio(&qu.audio);
     qu.audio.initialize(&qu.params);
@@ -130,10 +131,12 @@ void qu_terminate(void)
         return;
     }
 
+    libqu_terminate_particles();
     libqu_terminate_text();
 
     qu.audio.terminate();
     qu.graphics.terminate();
+    libqu_terminate_image_loader();
     qu.core.terminate();
 
     libqu_platform_terminate();
@@ -182,7 +185,6 @@ void qu_execute(qu_loop_fn loop_fn)
 void qu_present(void)
 {
     qu.graphics.swap();
-    qu.core.present();
 }
 
 //------------------------------------------------------------------------------
@@ -197,6 +199,20 @@ void *libqu_gl_proc_address(char const *name)
     return qu.core.gl_proc_address(name);
 }
 
+bool libqu_gl_make_current(bool current)
+{
+    if (!qu.core.gl_make_current) {
+        return false;
+    }
+
+    return qu.core.gl_make_current(current);
+}
+
+void libqu_gl_swap_buffers(void)
+{
+    qu.core.present();
+}
+
 void libqu_notify_gc_created(libqu_gc gc)
 {
     libqu_terminate_text();
@@ -373,6 +389,16 @@ void qu_rotate(float degrees)
     qu.graphics.rotate(degrees);
 }
 
+void qu_set_layer(int layer)
+{
+    qu.graphics.set_layer(layer);
+}
+
+void qu_set_outline_width(float width)
+{
+    qu.graphics.set_outline_width(width);
+}
+
 void qu_clear(qu_color color)
 {
     qu.graphics.clear(color);
@@ -417,6 +443,22 @@ qu_texture qu_load_texture(char const *path)
     return (qu_texture) { qu.graphics.load_texture(file) };
 }
 
+qu_texture qu_load_texture_async(char const *path)
+{
+    libqu_file *file = libqu_fopen(path);
+
+    if (!file) {
+        return (qu_texture) { 0 };
+    }
+
+    return (qu_texture) { qu.graphics.load_texture_async(file) };
+}
+
+bool qu_is_texture_ready(qu_texture texture)
+{
+    return qu.graphics.is_texture_ready(texture.id);
+}
+
 void qu_delete_texture(qu_texture texture)
 {
     qu.graphics.delete_texture(texture.id);
@@ -427,6 +469,11 @@ void qu_set_texture_smooth(qu_texture texture, bool smooth)
     qu.graphics.set_texture_smooth(texture.id, smooth);
 }
 
+void qu_set_texture_filter(qu_texture texture, qu_texture_filter filter)
+{
+    qu.graphics.set_texture_filter(texture.id, filter);
+}
+
 void qu_draw_texture(qu_texture texture, float x, float y, float w, float h)
 {
     qu.graphics.draw_texture(texture.id, x, y, w, h);
@@ -437,6 +484,11 @@ void qu_draw_subtexture(qu_texture texture, float x, float y, float w, float h,
     qu.graphics.draw_subtexture(texture.id, x, y, w, h, rx, ry, rw, rh);
 }
 
+void qu_draw_sprites(qu_texture texture, qu_sprite const *sprites, int count)
+{
+    qu.graphics.draw_sprites(texture.id, sprites, count);
+}
+
 qu_font qu_load_font(char const *path, float pt)
 {
     libqu_file *file = libqu_fopen(path);
@@ -490,7 +542,12 @@ void qu_draw_text_fmt(qu_font font, float x, float y, qu_color color, char const
 
 qu_surface qu_create_surface(int width, int height)
 {
-    return (qu_surface) { qu.graphics.create_surface(width, height) };
+    return (qu_surface) { qu.graphics.create_surface(width, height, false) };
+}
+
+qu_surface qu_create_surface_with_depth(int width, int height)
+{
+    return (qu_surface) { qu.graphics.create_surface(width, height, true) };
 }
 
 void qu_delete_surface(qu_surface surface)
@@ -498,6 +555,11 @@ void qu_delete_surface(qu_surface surface)
     qu.graphics.delete_surface(surface.id);
 }
 
+void qu_resize_surface(qu_surface surface, int width, int height)
+{
+    qu.graphics.resize_surface(surface.id, width, height);
+}
+
 void qu_set_surface(qu_surface surface)
 {
     qu.graphics.set_surface(surface.id);
@@ -513,6 +575,117 @@ void qu_draw_surface(qu_surface surface, float x, float y, float w, float h)
     qu.graphics.draw_surface(surface.id, x, y, w, h);
 }
 
+qu_command_list qu_create_command_list(void)
+{
+    return (qu_command_list) { qu.graphics.create_command_list() };
+}
+
+void qu_delete_command_list(qu_command_list list)
+{
+    qu.graphics.delete_command_list(list.id);
+}
+
+void qu_begin_command_list(qu_command_list list)
+{
+    qu.graphics.begin_command_list(list.id);
+}
+
+void qu_end_command_list(void)
+{
+    qu.graphics.end_command_list();
+}
+
+void qu_draw_command_list(qu_command_list list)
+{
+    qu.graphics.draw_command_list(list.id);
+}
+
+qu_tilemap qu_create_tilemap(qu_texture tileset, int tile_width, int tile_height,
+                             int columns, int rows, int const *tiles)
+{
+    return (qu_tilemap) {
+        qu.graphics.create_tilemap(tileset.id, tile_width, tile_height,
+                                   columns, rows, tiles)
+    };
+}
+
+void qu_delete_tilemap(qu_tilemap tilemap)
+{
+    qu.graphics.delete_tilemap(tilemap.id);
+}
+
+void qu_set_tile(qu_tilemap tilemap, int column, int row, int tile)
+{
+    qu.graphics.set_tile(tilemap.id, column, row, tile);
+}
+
+void qu_draw_tilemap(qu_tilemap tilemap, float x, float y)
+{
+    qu.graphics.draw_tilemap(tilemap.id, x, y);
+}
+
+void qu_begin_mesh(void)
+{
+    qu.graphics.begin_mesh();
+}
+
+qu_mesh qu_end_mesh(void)
+{
+    return (qu_mesh) { qu.graphics.end_mesh() };
+}
+
+void qu_delete_mesh(qu_mesh mesh)
+{
+    qu.graphics.delete_mesh(mesh.id);
+}
+
+void qu_draw_mesh(qu_mesh mesh, float x, float y)
+{
+    qu.graphics.draw_mesh(mesh.id, x, y);
+}
+
+qu_particle_system qu_create_particle_system(qu_texture texture, int capacity)
+{
+    return (qu_particle_system) {
+        libqu_create_particle_system(texture.id, capacity)
+    };
+}
+
+void qu_delete_particle_system(qu_particle_system system)
+{
+    libqu_delete_particle_system(system.id);
+}
+
+void qu_set_particle_gravity(qu_particle_system system, float x, float y)
+{
+    libqu_set_particle_gravity(system.id, x, y);
+}
+
+void qu_emit_particles(qu_particle_system system, qu_particle const *particles, int count)
+{
+    libqu_emit_particles(system.id, particles, count);
+}
+
+void qu_update_particle_system(qu_particle_system system, float dt)
+{
+    libqu_update_particle_system(system.id, dt);
+}
+
+int qu_get_particle_count(qu_particle_system system)
+{
+    return libqu_get_particle_count(system.id);
+}
+
+void qu_draw_particle_system(qu_particle_system system)
+{
+    libqu_draw_particle_system(system.id);
+}
+
+qu_render_stats qu_get_render_stats(void)
+{
+    return qu.graphics.get_render_stats();
+}
+
 //------------------------------------------------------------------------------
 
 void qu_set_master_volume(float volume)
@@ -30,14 +30,31 @@ static PFNGLUNIFORM4FVPROC                 pf_glUniform4fv;
 static PFNGLUNIFORMMATRIX4FVPROC           pf_glUniformMatrix4fv;
 static PFNGLUSEPROGRAMPROC                 pf_glUseProgram;
 
+static PFNGLCOMPRESSEDTEXIMAGE2DPROC       pf_glCompressedTexImage2D;
+
+static PFNGLGETPROGRAMBINARYPROC           pf_glGetProgramBinary;
+static PFNGLPROGRAMBINARYPROC              pf_glProgramBinary;
+static PFNGLPROGRAMPARAMETERIPROC          pf_glProgramParameteri;
+static PFNGLMAXSHADERCOMPILERTHREADSKHRPROC pf_glMaxShaderCompilerThreads;
+
 static PFNGLBINDBUFFERPROC                 pf_glBindBuffer;
 static PFNGLBUFFERDATAPROC                 pf_glBufferData;
 static PFNGLBUFFERSUBDATAPROC              pf_glBufferSubData;
+static PFNGLDELETEBUFFERSPROC              pf_glDeleteBuffers;
+static PFNGLMAPBUFFERRANGEPROC             pf_glMapBufferRange;
+static PFNGLUNMAPBUFFERPROC                pf_glUnmapBuffer;
+static PFNGLFENCESYNCPROC                  pf_glFenceSync;
+static PFNGLCLIENTWAITSYNCPROC             pf_glClientWaitSync;
+static PFNGLDELETESYNCPROC                 pf_glDeleteSync;
 static PFNGLDISABLEVERTEXATTRIBARRAYPROC   pf_glDisableVertexAttribArray;
 static PFNGLENABLEVERTEXATTRIBARRAYPROC    pf_glEnableVertexAttribArray;
 static PFNGLGENBUFFERSPROC                 pf_glGenBuffers;
+static PFNGLVERTEXATTRIB4FPROC             pf_glVertexAttrib4f;
 static PFNGLVERTEXATTRIBPOINTERPROC        pf_glVertexAttribPointer;
 
+static PFNGLVERTEXATTRIBDIVISORARBPROC      pf_glVertexAttribDivisorARB;
+static PFNGLDRAWELEMENTSINSTANCEDARBPROC    pf_glDrawElementsInstancedARB;
+
 static PFNGLBINDFRAMEBUFFEREXTPROC         pf_glBindFramebufferEXT;
 static PFNGLBINDRENDERBUFFEREXTPROC        pf_glBindRenderbufferEXT;
 static PFNGLCHECKFRAMEBUFFERSTATUSEXTPROC  pf_glCheckFramebufferStatusEXT;
@@ -48,6 +65,7 @@ static PFNGLGENRENDERBUFFERSEXTPROC        pf_glGenRenderbuffersEXT;
 static PFNGLFRAMEBUFFERRENDERBUFFEREXTPROC pf_glFramebufferRenderbufferEXT;
 static PFNGLFRAMEBUFFERTEXTURE2DEXTPROC    pf_glFramebufferTexture2DEXT;
 static PFNGLRENDERBUFFERSTORAGEEXTPROC     pf_glRenderbufferStorageEXT;
+static PFNGLGENERATEMIPMAPEXTPROC          pf_glGenerateMipmapEXT;
 
 //------------------------------------------------------------------------------
 // Adapter macros
@@ -94,14 +112,31 @@ static PFNGLRENDERBUFFERSTORAGEEXTPROC     pf_glRenderbufferStorageEXT;
 #define glUniformMatrix4fv              pf_glUniformMatrix4fv
 #define glUseProgram                    pf_glUseProgram
 
+#define glCompressedTexImage2D          pf_glCompressedTexImage2D
+
+#define glGetProgramBinary              pf_glGetProgramBinary
+#define glProgramBinary                 pf_glProgramBinary
+#define glProgramParameteri             pf_glProgramParameteri
+#define glMaxShaderCompilerThreads      pf_glMaxShaderCompilerThreads
+
 #define glBindBuffer                    pf_glBindBuffer
 #define glBufferData                    pf_glBufferData
 #define glBufferSubData                 pf_glBufferSubData
+#define glDeleteBuffers                 pf_glDeleteBuffers
+#define glMapBufferRange                pf_glMapBufferRange
+#define glUnmapBuffer                   pf_glUnmapBuffer
+#define glFenceSync                     pf_glFenceSync
+#define glClientWaitSync                pf_glClientWaitSync
+#define glDeleteSync                    pf_glDeleteSync
 #define glDisableVertexAttribArray      pf_glDisableVertexAttribArray
 #define glEnableVertexAttribArray       pf_glEnableVertexAttribArray
 #define glGenBuffers                    pf_glGenBuffers
+#define glVertexAttrib4f                pf_glVertexAttrib4f
 #define glVertexAttribPointer           pf_glVertexAttribPointer
 
+#define glVertexAttribDivisor           pf_glVertexAttribDivisorARB
+#define glDrawElementsInstanced         pf_glDrawElementsInstancedARB
+
 #define glBindFramebuffer               pf_glBindFramebufferEXT
 #define glBindRenderbuffer              pf_glBindRenderbufferEXT
 #define glCheckFramebufferStatus        pf_glCheckFramebufferStatusEXT
@@ -112,6 +147,7 @@ static PFNGLRENDERBUFFERSTORAGEEXTPROC     pf_glRenderbufferStorageEXT;
 #define glFramebufferRenderbuffer       pf_glFramebufferRenderbufferEXT
 #define glFramebufferTexture2D          pf_glFramebufferTexture2DEXT
 #define glRenderbufferStorage           pf_glRenderbufferStorageEXT
+#define glGenerateMipmap                pf_glGenerateMipmapEXT
 
 #define GL2_SHADER_VERTEX_SRC \
     "#version 120\n" \
@@ -133,36 +169,101 @@ static PFNGLRENDERBUFFERSTORAGEEXTPROC     pf_glRenderbufferStorageEXT;
 #define GL2_SHADER_SOLID_SRC \
     "#version 120\n" \
     "precision mediump float;\n" \
+    "varying vec4 v_color;\n" \
     "uniform vec4 u_color;\n" \
     "void main()\n" \
     "{\n" \
-    "    gl_FragColor = u_color;\n" \
+    "    gl_FragColor = v_color * u_color;\n" \
     "}\n"
 
 #define GL2_SHADER_TEXTURED_SRC \
     "#version 120\n" \
     "precision mediump float;\n" \
+    "varying vec4 v_color;\n" \
     "varying vec2 v_texCoord;\n" \
     "uniform sampler2D u_texture;\n" \
     "uniform vec4 u_color;\n" \
     "void main()\n" \
     "{\n" \
-    "    gl_FragColor = texture2D(u_texture, v_texCoord) * u_color;\n" \
+    "    gl_FragColor = texture2D(u_texture, v_texCoord) * v_color * u_color;\n" \
     "}\n"
 
 #define GL2_SHADER_CANVAS_SRC \
     "#version 120\n" \
     "attribute vec2 a_position;\n" \
+    "attribute vec4 a_color;\n" \
     "attribute vec2 a_texCoord;\n" \
+    "varying vec4 v_color;\n" \
     "varying vec2 v_texCoord;\n" \
     "uniform mat4 u_projection;\n" \
     "void main()\n" \
     "{\n" \
     "    v_texCoord = a_texCoord;\n" \
+    "    v_color = a_color;\n" \
     "    vec4 position = vec4(a_position, 0.0, 1.0);\n" \
     "    gl_Position = u_projection * position;\n" \
     "}\n"
 
+#define GL2_SHADER_SPRITE_SRC \
+    "#version 120\n" \
+    "attribute vec2 a_position;\n" \
+    "attribute vec4 a_color;\n" \
+    "attribute vec4 a_spriteRect;\n" \
+    "attribute vec4 a_spriteUV;\n" \
+    "attribute float a_spriteRotation;\n" \
+    "varying vec4 v_color;\n" \
+    "varying vec2 v_texCoord;\n" \
+    "uniform mat4 u_projection;\n" \
+    "uniform mat4 u_modelView;\n" \
+    "void main()\n" \
+    "{\n" \
+    "    vec2 corner = (a_position - 0.5) * a_spriteRect.zw;\n" \
+    "    float c = cos(a_spriteRotation);\n" \
+    "    float s = sin(a_spriteRotation);\n" \
+    "    vec2 offset = vec2(corner.x * c - corner.y * s, corner.x * s + corner.y * c);\n" \
+    "    v_texCoord = mix(a_spriteUV.xy, a_spriteUV.zw, a_position);\n" \
+    "    v_color = a_color;\n" \
+    "    vec4 position = vec4(a_spriteRect.xy + offset, 0.0, 1.0);\n" \
+    "    gl_Position = u_projection * u_modelView * position;\n" \
+    "}\n"
+
+#define GL2_SHADER_CIRCLE_VERTEX_SRC \
+    "#version 120\n" \
+    "attribute vec2 a_position;\n" \
+    "attribute vec4 a_color;\n" \
+    "attribute vec4 a_outlineColor;\n" \
+    "attribute vec4 a_circle;\n" \
+    "varying vec4 v_color;\n" \
+    "varying vec4 v_outlineColor;\n" \
+    "varying vec4 v_circle;\n" \
+    "uniform mat4 u_projection;\n" \
+    "uniform mat4 u_modelView;\n" \
+    "void main()\n" \
+    "{\n" \
+    "    v_color = a_color;\n" \
+    "    v_outlineColor = a_outlineColor;\n" \
+    "    v_circle = a_circle;\n" \
+    "    vec4 position = vec4(a_position, 0.0, 1.0);\n" \
+    "    gl_Position = u_projection * u_modelView * position;\n" \
+    "}\n"
+
+#define GL2_SHADER_CIRCLE_SRC \
+    "#version 120\n" \
+    "precision mediump float;\n" \
+    "varying vec4 v_color;\n" \
+    "varying vec4 v_outlineColor;\n" \
+    "varying vec4 v_circle;\n" \
+    "uniform vec4 u_color;\n" \
+    "void main()\n" \
+    "{\n" \
+    "    float d = length(v_circle.xy);\n" \
+    "    float w = v_circle.w * 0.5;\n" \
+    "    float coverage = clamp(v_circle.z + w - d + 0.5, 0.0, 1.0);\n" \
+    "    float inner = clamp(v_circle.z - w - d + 0.5, 0.0, 1.0);\n" \
+    "    vec4 color = mix(v_outlineColor, v_color, inner);\n" \
+    "    gl_FragColor = vec4(color.rgb, color.a * coverage) * u_color;\n" \
+    "}\n"
+
 //------------------------------------------------------------------------------
 // Shared implementation
 
@@ -184,6 +285,37 @@ static void load_glext(char const *extension)
         pf_glFramebufferRenderbufferEXT = libqu_gl_proc_address("glFramebufferRenderbufferEXT");
         pf_glFramebufferTexture2DEXT = libqu_gl_proc_address("glFramebufferTexture2DEXT");
         pf_glRenderbufferStorageEXT = libqu_gl_proc_address("glRenderbufferStorageEXT");
+        pf_glGenerateMipmapEXT = libqu_gl_proc_address("glGenerateMipmapEXT");
+        g_caps.generate_mipmap = (pf_glGenerateMipmapEXT != NULL);
+    } else if (strcmp(extension, "GL_ARB_map_buffer_range") == 0) {
+        pf_glMapBufferRange = libqu_gl_proc_address("glMapBufferRange");
+        g_caps.map_buffer_range = (pf_glMapBufferRange != NULL);
+    } else if (strcmp(extension, "GL_ARB_sync") == 0) {
+        pf_glFenceSync = libqu_gl_proc_address("glFenceSync");
+        pf_glClientWaitSync = libqu_gl_proc_address("glClientWaitSync");
+        pf_glDeleteSync = libqu_gl_proc_address("glDeleteSync");
+        g_caps.sync = pf_glFenceSync && pf_glClientWaitSync && pf_glDeleteSync;
+    } else if (strcmp(extension, "GL_ARB_instanced_arrays") == 0) {
+        pf_glVertexAttribDivisorARB = libqu_gl_proc_address("glVertexAttribDivisorARB");
+        pf_glDrawElementsInstancedARB = libqu_gl_proc_address("glDrawElementsInstancedARB");
+        g_caps.instanced_arrays = pf_glVertexAttribDivisorARB && pf_glDrawElementsInstancedARB;
+    } else if (strcmp(extension, "GL_ARB_pixel_buffer_object") == 0) {
+        g_caps.pixel_buffer = true;
+    } else if (strcmp(extension, "GL_EXT_texture_compression_s3tc") == 0) {
+        g_caps.texture_s3tc = true;
+    } else if (strcmp(extension, "GL_ARB_ES3_compatibility") == 0) {
+        g_caps.texture_etc2 = true;
+    } else if (strcmp(extension, "GL_ARB_get_program_binary") == 0) {
+        pf_glGetProgramBinary = libqu_gl_proc_address("glGetProgramBinary");
+        pf_glProgramBinary = libqu_gl_proc_address("glProgramBinary");
+        pf_glProgramParameteri = libqu_gl_proc_address("glProgramParameteri");
+        g_caps.program_binary = pf_glGetProgramBinary && pf_glProgramBinary && pf_glProgramParameteri;
+    } else if (strcmp(extension, "GL_KHR_parallel_shader_compile") == 0) {
+        pf_glMaxShaderCompilerThreads = libqu_gl_proc_address("glMaxShaderCompilerThreadsKHR");
+        g_caps.parallel_compile = (pf_glMaxShaderCompilerThreads != NULL);
+    } else if (strcmp(extension, "GL_ARB_parallel_shader_compile") == 0 && !pf_glMaxShaderCompilerThreads) {
+        pf_glMaxShaderCompilerThreads = libqu_gl_proc_address("glMaxShaderCompilerThreadsARB");
+        g_caps.parallel_compile = (pf_glMaxShaderCompilerThreads != NULL);
     }
 }
 
@@ -207,31 +339,20 @@ static void load_gl_functions(void)
     pf_glUniformMatrix4fv = libqu_gl_proc_address("glUniformMatrix4fv");
     pf_glUseProgram = libqu_gl_proc_address("glUseProgram");
 
+    pf_glCompressedTexImage2D = libqu_gl_proc_address("glCompressedTexImage2D");
+
     pf_glBindBuffer = libqu_gl_proc_address("glBindBuffer");
     pf_glBufferData = libqu_gl_proc_address("glBufferData");
     pf_glBufferSubData = libqu_gl_proc_address("glBufferSubData");
+    pf_glDeleteBuffers = libqu_gl_proc_address("glDeleteBuffers");
+    pf_glUnmapBuffer = libqu_gl_proc_address("glUnmapBuffer");
     pf_glDisableVertexAttribArray = libqu_gl_proc_address("glDisableVertexAttribArray");
     pf_glEnableVertexAttribArray = libqu_gl_proc_address("glEnableVertexAttribArray");
     pf_glGenBuffers = libqu_gl_proc_address("glGenBuffers");
+    pf_glVertexAttrib4f = libqu_gl_proc_address("glVertexAttrib4f");
     pf_glVertexAttribPointer = libqu_gl_proc_address("glVertexAttribPointer");
 
-    char *extensions = qu_strdup((char const *) glGetString(GL_EXTENSIONS));
-
-    libqu_info("Supported OpenGL extensions:\n");
-    libqu_info("%s\n", extensions);
-
-    char *token = strtok(extensions, " ");
-    int count = 0;
-
-    while (token) {
-        load_glext(token);
-        token = strtok(NULL, " ");
-        count++;
-    }
-
-    libqu_info("Total OpenGL extensions: %d\n", count);
-
-    free(extensions);
+    gl2__load_extensions(load_glext);
 }
 
 static bool check_glext(char const *extension)
@@ -265,6 +386,9 @@ static void initialize(qu_params const *params)
         libqu_halt("Required OpenGL extension GL_EXT_framebuffer_object is not supported.\n");
     }
 
+    // Non-power-of-two textures are core since OpenGL 2.0.
+    g_caps.npot_mipmaps = true;
+
     gl2_initialize(params);
 }
 
@@ -293,6 +417,8 @@ void libqu_construct_gl2_graphics(libqu_graphics *graphics)
         .translate = gl2_translate,
         .scale = gl2_scale,
         .rotate = gl2_rotate,
+        .set_layer = gl2_set_layer,
+        .set_outline_width = gl2_set_outline_width,
         .clear = gl2_clear,
         .draw_point = gl2_draw_point,
         .draw_line = gl2_draw_line,
@@ -302,15 +428,35 @@ void libqu_construct_gl2_graphics(libqu_graphics *graphics)
         .create_texture = gl2_create_texture,
         .update_texture = gl2_update_texture,
         .load_texture = gl2_load_texture,
+        .load_texture_async = gl2_load_texture_async,
+        .is_texture_ready = gl2_is_texture_ready,
         .delete_texture = gl2_delete_texture,
         .set_texture_smooth = gl2_set_texture_smooth,
+        .set_texture_filter = gl2_set_texture_filter,
         .draw_texture = gl2_draw_texture,
         .draw_subtexture = gl2_draw_subtexture,
+        .draw_sprites = gl2_draw_sprites,
+        .draw_particles = gl2_draw_particles,
         .draw_text = gl2_draw_text,
         .create_surface = gl2_create_surface,
         .delete_surface = gl2_delete_surface,
+        .resize_surface = gl2_resize_surface,
         .set_surface = gl2_set_surface,
         .reset_surface = gl2_reset_surface,
         .draw_surface = gl2_draw_surface,
+        .create_command_list = gl2_create_command_list,
+        .delete_command_list = gl2_delete_command_list,
+        .begin_command_list = gl2_begin_command_list,
+        .end_command_list = gl2_end_command_list,
+        .draw_command_list = gl2_draw_command_list,
+        .create_tilemap = gl2_create_tilemap,
+        .delete_tilemap = gl2_delete_tilemap,
+        .set_tile = gl2_set_tile,
+        .draw_tilemap = gl2_draw_tilemap,
+        .begin_mesh = gl2_begin_mesh,
+        .end_mesh = gl2_end_mesh,
+        .delete_mesh = gl2_delete_mesh,
+        .draw_mesh = gl2_draw_mesh,
+        .get_render_stats = gl2_get_render_stats,
     };
 }
@@ -12,6 +12,49 @@
 
 #define GL2__MAX_MATRICES               (32)
 
+// Number of quads addressable with 16-bit indices
+#define GL2__MAX_QUADS                  (16384)
+
+// Number of VBOs each vertex format cycles through
+#define GL2__VBO_RING_SIZE              (3)
+
+// Longest wait for the GPU to be done with a VBO of the ring, in ns
+#define GL2__FENCE_TIMEOUT              (100000000)
+
+// Number of pixel buffers texture uploads cycle through
+#define GL2__PBO_RING_SIZE              (3)
+
+// Loaded textures not larger than this are packed into atlas pages
+#define GL2__ATLAS_MAX_TEXTURE_SIZE     (256)
+#define GL2__ATLAS_PAGE_SIZE            (1024)
+
+// Edge pixels of packed textures are repeated this many times around
+// them, so that filtering doesn't pick up neighbours
+#define GL2__ATLAS_PADDING              (1)
+
+// Tilemaps are stored and culled in square chunks of this many tiles
+#define GL2__TILEMAP_CHUNK_SIZE         (32)
+
+// Deleted surfaces kept for reuse by surfaces of the same size
+#define GL2__SURFACE_POOL_SIZE          (8)
+
+// Compressed formats may be missing from older headers
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT     0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT    0x83F1
+#define GL_COMPRESSED_RGBA_S3TC_DXT3_EXT    0x83F2
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT    0x83F3
+#endif
+
+#ifndef GL_ETC1_RGB8_OES
+#define GL_ETC1_RGB8_OES                    0x8D64
+#endif
+
+#ifndef GL_COMPRESSED_RGB8_ETC2
+#define GL_COMPRESSED_RGB8_ETC2             0x9274
+#define GL_COMPRESSED_RGBA8_ETC2_EAC        0x9278
+#endif
+
 //------------------------------------------------------------------------------
 
 enum
@@ -19,6 +62,11 @@ enum
     GL2__ATTR_POSITION,
     GL2__ATTR_COLOR,
     GL2__ATTR_TEXCOORD,
+    GL2__ATTR_SPRITE_RECT,
+    GL2__ATTR_SPRITE_UV,
+    GL2__ATTR_SPRITE_ROTATION,
+    GL2__ATTR_OUTLINE_COLOR,
+    GL2__ATTR_CIRCLE,
     GL2__ATTR_TOTAL,
 };
 
@@ -26,6 +74,10 @@ enum
 {
     GL2__VF_SOLID,
     GL2__VF_TEXTURED,
+    GL2__VF_SOLID_COLORED,
+    GL2__VF_TEXTURED_COLORED,
+    GL2__VF_SPRITE,
+    GL2__VF_CIRCLE,
     GL2__VF_TOTAL,
 };
 
@@ -35,6 +87,9 @@ enum
     GL2__SHADER_SOLID,
     GL2__SHADER_TEXTURED,
     GL2__SHADER_CANVAS,
+    GL2__SHADER_SPRITE,
+    GL2__SHADER_CIRCLE_VERTEX,
+    GL2__SHADER_CIRCLE,
     GL2__SHADER_TOTAL,
 };
 
@@ -43,6 +98,8 @@ enum
     GL2__PROG_SHAPE,
     GL2__PROG_TEXTURE,
     GL2__PROG_CANVAS,
+    GL2__PROG_SPRITE,
+    GL2__PROG_CIRCLE,
     GL2__PROG_TOTAL,
 };
 
@@ -69,6 +126,10 @@ enum
     GL2__CMD_SCALE,
     GL2__CMD_ROTATE,
     GL2__CMD_RESIZE,
+    GL2__CMD_CALL_LIST,
+    GL2__CMD_DRAW_TILEMAP,
+    GL2__CMD_DRAW_MESH,
+    GL2__CMD_TOTAL,
 };
 
 typedef struct
@@ -93,17 +154,140 @@ typedef struct
 
     GLint channels;
     GLenum format;
+
+    bool smooth;                // magnification filter is linear
+    GLenum min_filter;          // minification filter
+
+    // Compressed textures can't be updated or packed, and their mip
+    // levels can only come from the file.
+    int compressed_levels;      // mip levels uploaded, 0 if not compressed
+
+    // Textures packed into an atlas page have no GL texture of their own,
+    // they are drawn with texture of the page instead.
+    int32_t atlas_id;           // texture of the page, 0 if not packed
+    int atlas_page;             // index of the page
+    int atlas_x;                // position in the page, in pixels
+    int atlas_y;
+    float s0, t0, s1, t1;       // texture coordinates in the page
+
+    // Textures loaded asynchronously are drawn with the placeholder
+    // until the image is decoded and uploaded.
+    libqu_image_job *job;       // pending decode job, NULL once loaded
+    bool failed;                // decoding or upload failed
 } gl2__texture;
 
+typedef struct
+{
+    int32_t *ids;
+    int count;
+    int capacity;
+} gl2__pending_loads;
+
+// Display size as known to the calling thread. Copies in g_state
+// are written by the render thread when the resize is executed.
+typedef struct
+{
+    int width;
+    int height;
+    float aspect;
+} gl2__display;
+
+// Render target and view the frame's draws will be executed with,
+// tracked while the frame is recorded. Calling thread only.
+typedef struct
+{
+    int32_t surface_id;         // -1 if unknown
+    bool valid;                 // view bounds are known
+    bool transformed;           // model-view matrix may not be identity
+    float l, t, r, b;           // view bounds
+} gl2__cull_state;
+
+typedef struct
+{
+    int32_t texture_id;
+    int x;
+    int y;
+    int w;
+    int h;
+    GLenum format;
+    size_t offset;              // position of pixels in the staging buffer
+} gl2__upload;
+
+// Texture updates made during a frame are gathered in one staging
+// buffer and uploaded together before the frame is rendered.
+typedef struct
+{
+    unsigned char *data;
+    size_t size;
+    size_t capacity;
+    gl2__upload *uploads;
+    int count;
+    int max_count;
+    GLuint pbo[GL2__PBO_RING_SIZE];
+    int pbo_index;
+} gl2__upload_buf;
+
+typedef struct
+{
+    int x;
+    int y;
+    int width;
+} gl2__skyline_node;
+
+typedef struct
+{
+    int32_t texture_id;         // GL texture holding the page
+    bool smooth;                // filtering of every texture in the page
+    GLenum min_filter;
+    int refs;                   // number of textures packed into the page
+    unsigned char *pixels;      // copy of the page contents, RGBA
+    gl2__skyline_node *skyline; // top edge of the packed area
+    int skyline_count;
+} gl2__atlas_page;
+
+typedef struct
+{
+    gl2__atlas_page *pages;
+    int page_count;
+    int page_size;              // width and height of every page
+} gl2__atlas;
+
 typedef struct
 {
     GLuint handle;
-    GLuint depth;
+    GLuint depth;               // 0 if there is no depth attachment
     int32_t color_id;
     int width;
     int height;
 } gl2__surface;
 
+typedef struct
+{
+    GLuint vbo;                 // GL2__VF_TEXTURED_COLORED quads
+    int quad_count;
+    bool dirty;                 // tiles changed since the last build
+} gl2__tilemap_chunk;
+
+// Chunks are rebuilt at present of a frame which draws the tilemap.
+typedef struct
+{
+    int32_t texture_id;         // tileset
+    int tile_width;
+    int tile_height;
+    int columns;
+    int rows;
+    int *tiles;                 // row-major, negative for empty tiles
+
+    gl2__tilemap_chunk *chunks;
+    int chunk_columns;
+    int chunk_rows;
+    bool dirty;                 // any chunk is dirty
+
+    // Texture coordinates of the tileset chunks were built with,
+    // they change when the texture is loaded or moved between pages.
+    float s0, t0, s1, t1;
+} gl2__tilemap;
+
 typedef struct
 {
     GLuint handle;
@@ -111,67 +295,246 @@ typedef struct
     uint32_t dirty;
 } gl2__prog;
 
+// Commands are stored in the command buffer as a packed stream of
+// records. Each record is a header followed by payload of the command,
+// padded to keep the next record 8-byte aligned.
+
 typedef struct
 {
-    int type;
-
-    union
-    {
-        struct
-        {
-            qu_color color;
-        } clear;
-
-        struct
-        {
-            qu_color color;
-            int32_t texture_id;
-            int program;
-            int format;
-            int mode;
-            int first;
-            int count;
-        } draw;
-
-        struct
-        {
-            int32_t id;
-        } surface;
-
-        struct
-        {
-            float x;
-            float y;
-            float w;
-            float h;
-            float r;
-        } view;
-
-        struct
-        {
-            int w;
-            int h;
-        } size;
-    };
-} gl2__cmd;
+    uint32_t type;
+    uint32_t size;              // size of the whole record in bytes
+} gl2__cmd_header;
 
 typedef struct
 {
-    gl2__cmd *array;
-    unsigned int size;
-    unsigned int capacity;
+    qu_color color;
+} gl2__cmd_clear;
+
+typedef struct
+{
+    qu_color color;
+    int32_t texture_id;
+    uint8_t program;
+    uint8_t format;
+    uint8_t mode;
+    bool indexed;
+    bool instanced;             // draw `count` instances of GL2__VF_SPRITE
+    bool resolve;               // in meshes: `texture_id` is the texture
+                                // drawn, not the one bound, see gl2__mesh
+    int32_t first;
+    int32_t count;
+    int32_t layer;
+} gl2__cmd_draw;
+
+typedef struct
+{
+    int32_t id;
+} gl2__cmd_surface;
+
+typedef struct
+{
+    float x;
+    float y;
+    float w;
+    float h;
+    float r;
+} gl2__cmd_view;
+
+typedef struct
+{
+    float x;
+    float y;
+} gl2__cmd_vec2;
+
+typedef struct
+{
+    float degrees;
+} gl2__cmd_rotate;
+
+typedef struct
+{
+    int w;
+    int h;
+} gl2__cmd_resize;
+
+typedef struct
+{
+    int32_t id;
+} gl2__cmd_call;
+
+typedef struct
+{
+    int32_t id;
+    int32_t texture_id;         // filled in at present
+    qu_mat4 matrix;             // record-time transformation and position
+    int32_t layer;
+} gl2__cmd_tilemap;
+
+typedef struct
+{
+    int32_t id;
+    qu_mat4 matrix;             // record-time transformation and position
+    int32_t layer;
+} gl2__cmd_mesh;
+
+typedef struct
+{
+    unsigned char *data;
+    unsigned int size;          // in bytes
+    unsigned int capacity;      // in bytes
+    unsigned int count;         // number of records
 } gl2__cmd_buf;
 
+// Region of the texture a textured quad or sprite instance of a mesh
+// was drawn with, in pixels. Whole width or height is taken from the
+// texture, as it isn't known until the texture is loaded.
+typedef struct
+{
+    float x, y, w, h;
+    bool whole_w;
+    bool whole_h;
+} gl2__source_rect;
+
+// Textured draw of a mesh and placement of the texture its texture
+// coordinates were built for.
+typedef struct
+{
+    unsigned int offset;        // offset of the record in mesh commands
+    int32_t texture_id;         // texture drawn, not the atlas page
+    int rect;                   // index of the first source rectangle
+    float s0, t0, s1, t1;
+    int width;
+    int height;
+} gl2__mesh_draw;
+
+// Draw and transformation commands captured between qu_begin_mesh()
+// and qu_end_mesh(). Vertex data stays in VBOs of the mesh, draws
+// refer to it from the beginning of these VBOs.
+// Textures may be loaded or moved between atlas pages after the mesh
+// is made, so textured draws are resolved again when the mesh is
+// drawn. Their vertices are kept to rebuild texture coordinates.
+typedef struct
+{
+    gl2__cmd_buf commands;
+    GLuint vbo[GL2__VF_TOTAL];  // 0 if the format isn't used
+
+    gl2__mesh_draw *draws;
+    int draw_count;
+    gl2__source_rect *rects;
+    unsigned char *vertices[GL2__VF_TOTAL]; // only if textured draws use them
+} gl2__mesh;
+
+typedef struct
+{
+    uint64_t key;
+    unsigned int offset;        // offset of the record in the command buffer
+} gl2__sort_item;
+
 typedef struct
 {
-    float *array;
-    unsigned int size;
+    gl2__sort_item *items[2];   // ping-pong arrays of radix sort
     unsigned int capacity;
+    unsigned char *data;        // records in sorted order
+    unsigned int data_capacity;
+} gl2__sort_buf;
 
-    GLuint vbo;
-    GLuint vbo_size;
+typedef struct
+{
+    GLint size;                 // number of components, 0 if not present
+    GLenum type;
+    GLboolean normalized;
+    GLuint divisor;             // 1 for per-instance attributes
+} gl2__attr_format;
+
+// Vertex layout of GL2__VF_SOLID_COLORED
+typedef struct
+{
+    GLfloat x, y;
+    GLubyte color[4];
+} gl2__solid_vertex;
+
+// Vertex layout of GL2__VF_TEXTURED_COLORED
+typedef struct
+{
+    GLfloat x, y;
+    GLubyte color[4];
+    GLushort s, t;
+} gl2__textured_vertex;
+
+// Instance layout of GL2__VF_SPRITE
+typedef struct
+{
+    GLubyte color[4];
+    GLfloat x, y, w, h;         // center and size
+    GLushort s0, t0, s1, t1;    // texture rectangle
+    GLfloat rotation;           // in radians
+} gl2__sprite_instance;
+
+// Vertex layout of GL2__VF_CIRCLE
+typedef struct
+{
+    GLfloat x, y;
+    GLubyte color[4];           // fill
+    GLubyte outline[4];
+    GLfloat cx, cy;             // position relative to the center
+    GLfloat radius, outline_width;
+} gl2__circle_vertex;
+
+typedef struct
+{
+    unsigned char *array;
+    unsigned int size;          // in bytes
+    unsigned int capacity;      // in bytes
+} gl2__vertex_array;
+
+// Commands and vertex data recorded by one thread: either the frame
+// itself, or a command list which is spliced into it at present.
+typedef struct
+{
+    gl2__cmd_buf commands;
+    gl2__vertex_array vertices[GL2__VF_TOTAL];
+    gl2__vertex_array rects;    // gl2__source_rect, recorded by meshes only
+    bool layered;               // non-zero layer was used in this list
+    int calls;                  // number of GL2__CMD_CALL_LIST records
+
+    int layer;                  // layer of recorded draw commands
+    float outline_width;        // width of recorded shape outlines
+    qu_mat4 baked_matrix[GL2__MAX_MATRICES];
+    int baked_current_matrix;
+} gl2__cmd_list;
+
+typedef struct
+{
+    unsigned int stride;        // size of one vertex in bytes
+
+    // Vertex data is copied here when draw commands are reordered.
+    unsigned char *spare;
+    unsigned int spare_capacity;
+
+    // Each frame is uploaded to the next VBO in the ring, so the driver
+    // doesn't have to wait until the GPU is done with the previous one.
+    GLuint vbo[GL2__VBO_RING_SIZE];
+    GLsizeiptr vbo_size[GL2__VBO_RING_SIZE];
+    GLsync fence[GL2__VBO_RING_SIZE];   // signaled when GPU is done with VBO
+    int vbo_index;
 } gl2__vertex_buf;
 
+typedef struct
+{
+    bool map_buffer_range;      // glMapBufferRange() is available
+    bool sync;                  // glFenceSync() is available
+    bool instanced_arrays;      // glVertexAttribDivisor() and
+                                // glDrawElementsInstanced() are available
+    bool pixel_buffer;          // GL_PIXEL_UNPACK_BUFFER can be mapped
+    bool generate_mipmap;       // glGenerateMipmap() is available
+    bool npot_mipmaps;          // mipmaps of NPOT textures are supported
+    bool texture_s3tc;          // DXT1, DXT3 and DXT5 are supported
+    bool texture_etc1;          // ETC1 is supported
+    bool texture_etc2;          // ETC2 (and ETC1 through it) is supported
+    bool program_binary;        // glGetProgramBinary() is available
+    bool parallel_compile;      // glMaxShaderCompilerThreads() is available
+} gl2__caps;
+
 typedef struct
 {
     bool use_canvas;
@@ -191,9 +554,13 @@ typedef struct
     float canvas_by;            // calculated canvas bottom-most point
 
     int texture_id;             // currently bound texture
+    int32_t placeholder_id;     // transparent texture drawn while loading
     int surface_id;             // currently active framebuffer
     int program;                // currently used program
     int vertex_format;          // current vertex format
+    int vertex_base;            // first vertex of current attribute pointers
+    GLuint const *mesh_vbos;    // vertex source of the mesh being drawn
+    GLuint divisors[GL2__ATTR_TOTAL]; // current attribute divisors
     qu_color clear_color;       // current clear color
     qu_color draw_color;        // current draw color
     float draw_color_f[4];
@@ -201,43 +568,148 @@ typedef struct
     qu_mat4 projection;
     qu_mat4 matrix[GL2__MAX_MATRICES];
     int current_matrix;
+
+    bool bake_transforms;       // apply transformations to vertices on CPU
+
+    qu_render_stats stats;      // statistics of the last executed frame
 } gl2__state;
 
+// Guarded by `mutex` unless noted otherwise.
+typedef struct
+{
+    libqu_thread *thread;
+    libqu_mutex *mutex;
+    libqu_cond *cond;
+
+    bool pending;               // submitted frame waits to be rendered
+    bool busy;                  // frame is being rendered
+    bool quit;                  // render thread should stop
+    bool context_request;       // calling thread needs the GL context
+    bool has_context;           // GL context is current on render thread
+
+    qu_render_stats stats;      // statistics of the last rendered frame
+} gl2__render_thread;
+
 //------------------------------------------------------------------------------
 
 static char const *s_attr_names[GL2__ATTR_TOTAL] = {
     "a_position", "a_color", "a_texCoord",
+    "a_spriteRect", "a_spriteUV", "a_spriteRotation",
+    "a_outlineColor", "a_circle",
 };
 
-static int s_attr_sizes[GL2__ATTR_TOTAL] = { 2, 4, 2 };
-
-static int s_vf_masks[GL2__VF_TOTAL] = { 0x01, 0x05 };
+// Colored formats store color as normalized bytes and texture
+// coordinates as normalized shorts to keep vertices small.
+static gl2__attr_format s_vf_attrs[GL2__VF_TOTAL][GL2__ATTR_TOTAL] = {
+    {   // GL2__VF_SOLID
+        { 2, GL_FLOAT, GL_FALSE, 0 },
+    },
+    {   // GL2__VF_TEXTURED
+        { 2, GL_FLOAT, GL_FALSE, 0 },
+        { 0 },
+        { 2, GL_FLOAT, GL_FALSE, 0 },
+    },
+    {   // GL2__VF_SOLID_COLORED
+        { 2, GL_FLOAT, GL_FALSE, 0 },
+        { 4, GL_UNSIGNED_BYTE, GL_TRUE, 0 },
+    },
+    {   // GL2__VF_TEXTURED_COLORED
+        { 2, GL_FLOAT, GL_FALSE, 0 },
+        { 4, GL_UNSIGNED_BYTE, GL_TRUE, 0 },
+        { 2, GL_UNSIGNED_SHORT, GL_TRUE, 0 },
+    },
+    {   // GL2__VF_SPRITE, position comes from g_unit_quad_vbo
+        { 0 },
+        { 4, GL_UNSIGNED_BYTE, GL_TRUE, 1 },
+        { 0 },
+        { 4, GL_FLOAT, GL_FALSE, 1 },
+        { 4, GL_UNSIGNED_SHORT, GL_TRUE, 1 },
+        { 1, GL_FLOAT, GL_FALSE, 1 },
+    },
+    {   // GL2__VF_CIRCLE
+        { 2, GL_FLOAT, GL_FALSE, 0 },
+        { 4, GL_UNSIGNED_BYTE, GL_TRUE, 0 },
+        { 0 },
+        { 0 },
+        { 0 },
+        { 0 },
+        { 4, GL_UNSIGNED_BYTE, GL_TRUE, 0 },
+        { 4, GL_FLOAT, GL_FALSE, 0 },
+    },
+};
 
 static gl2__shader_desc s_shaders[GL2__SHADER_TOTAL] = {
     { GL_VERTEX_SHADER, "SHADER_VERTEX", GL2_SHADER_VERTEX_SRC },
     { GL_FRAGMENT_SHADER, "SHADER_SOLID", GL2_SHADER_SOLID_SRC },
     { GL_FRAGMENT_SHADER, "SHADER_TEXTURED", GL2_SHADER_TEXTURED_SRC },
     { GL_VERTEX_SHADER, "SHADER_CANVAS", GL2_SHADER_CANVAS_SRC },
+    { GL_VERTEX_SHADER, "SHADER_SPRITE", GL2_SHADER_SPRITE_SRC },
+    { GL_VERTEX_SHADER, "SHADER_CIRCLE_VERTEX", GL2_SHADER_CIRCLE_VERTEX_SRC },
+    { GL_FRAGMENT_SHADER, "SHADER_CIRCLE", GL2_SHADER_CIRCLE_SRC },
 };
 
 static gl2__prog_desc s_progs[GL2__PROG_TOTAL] = {
     { "PROGRAM_SHAPE", GL2__SHADER_VERTEX, GL2__SHADER_SOLID },
     { "PROGRAM_TEXTURE", GL2__SHADER_VERTEX, GL2__SHADER_TEXTURED },
     { "PROGRAM_CANVAS", GL2__SHADER_CANVAS, GL2__SHADER_TEXTURED },
+    { "PROGRAM_SPRITE", GL2__SHADER_SPRITE, GL2__SHADER_TEXTURED },
+    { "PROGRAM_CIRCLE", GL2__SHADER_CIRCLE_VERTEX, GL2__SHADER_CIRCLE },
 };
 
 static char const *s_uniform_names[GL2__UNI_TOTAL] = {
     "u_projection", "u_modelView", "u_color",
 };
 
+// Payload size of each command
+static unsigned int const s_cmd_sizes[GL2__CMD_TOTAL] = {
+    [GL2__CMD_CLEAR] = sizeof(gl2__cmd_clear),
+    [GL2__CMD_DRAW] = sizeof(gl2__cmd_draw),
+    [GL2__CMD_SET_SURFACE] = sizeof(gl2__cmd_surface),
+    [GL2__CMD_SET_VIEW] = sizeof(gl2__cmd_view),
+    [GL2__CMD_TRANSLATE] = sizeof(gl2__cmd_vec2),
+    [GL2__CMD_SCALE] = sizeof(gl2__cmd_vec2),
+    [GL2__CMD_ROTATE] = sizeof(gl2__cmd_rotate),
+    [GL2__CMD_RESIZE] = sizeof(gl2__cmd_resize),
+    [GL2__CMD_CALL_LIST] = sizeof(gl2__cmd_call),
+    [GL2__CMD_DRAW_TILEMAP] = sizeof(gl2__cmd_tilemap),
+    [GL2__CMD_DRAW_MESH] = sizeof(gl2__cmd_mesh),
+};
+
 //------------------------------------------------------------------------------
 
 static gl2__state           g_state;
-static gl2__cmd_buf         g_cmd_buf;
+static gl2__caps            g_caps;
+static gl2__cmd_list        g_frames[2];
+static gl2__cmd_list        *g_record_frame;    // frame being recorded
+static gl2__cmd_list        *g_render_frame;    // frame being rendered
+static gl2__render_thread   g_render_thread;
+static libqu_array          *g_cmd_lists;
+static gl2__atlas           g_atlas;
+static gl2__pending_loads   g_pending_loads;
+static gl2__display         g_display;
+static gl2__cull_state      g_cull;
+static gl2__upload_buf      g_upload_buf;
+static gl2__cmd_buf         g_splice_buf;
+static gl2__sort_buf        g_sort_buf;
 static gl2__vertex_buf      g_vertex_bufs[GL2__VF_TOTAL];
 static libqu_array          *g_textures;
 static libqu_array          *g_surfaces;
+static libqu_mutex          *g_resource_mutex;
+static gl2__surface         g_surface_pool[GL2__SURFACE_POOL_SIZE];
+static int                  g_surface_pool_count;
+static libqu_array          *g_tilemaps;
+static libqu_array          *g_meshes;
+static int                  g_tilemap_count;
 static gl2__prog            g_progs[GL2__PROG_TOTAL];
+static GLuint               g_quad_ibo;
+static GLuint               g_unit_quad_vbo;
+
+// Command list being recorded by the current thread, if any
+static LIBQU_THREAD_LOCAL gl2__cmd_list *t_cmd_list;
+static LIBQU_THREAD_LOCAL gl2__cmd_list *t_mesh_list;
+
+// Nesting of gl2__acquire_context() calls on the current thread
+static LIBQU_THREAD_LOCAL int t_context_depth;
 
 //------------------------------------------------------------------------------
 
@@ -249,6 +721,42 @@ static void gl2__unpack_color(qu_color c, float *a)
     a[3] = ((c >> 24) & 255) / 255.f;
 }
 
+static void gl2__pack_color(qu_color c, GLubyte *a)
+{
+    a[0] = (c >> 16) & 255;
+    a[1] = (c >> 8) & 255;
+    a[2] = (c >> 0) & 255;
+    a[3] = (c >> 24) & 255;
+}
+
+static GLushort gl2__pack_texcoord(float x)
+{
+    return (GLushort) (QU_MAX(0.f, QU_MIN(1.f, x)) * 65535.f + 0.5f);
+}
+
+static GLsizei gl2__get_attr_size(gl2__attr_format const *attr)
+{
+    switch (attr->type) {
+    case GL_UNSIGNED_BYTE:
+        return attr->size * sizeof(GLubyte);
+    case GL_UNSIGNED_SHORT:
+        return attr->size * sizeof(GLushort);
+    default:
+        return attr->size * sizeof(GLfloat);
+    }
+}
+
+static GLsizei gl2__get_vertex_stride(int format)
+{
+    GLsizei stride = 0;
+
+    for (int i = 0; i < GL2__ATTR_TOTAL; i++) {
+        stride += gl2__get_attr_size(&s_vf_attrs[format][i]);
+    }
+
+    return stride;
+}
+
 static GLenum gl2__get_texture_format(int channels)
 {
     switch (channels) {
@@ -265,12 +773,131 @@ static GLenum gl2__get_texture_format(int channels)
     }
 }
 
+/**
+ * Get GL format for compressed image data, or GL_INVALID_ENUM if the
+ * GPU doesn't support it.
+ */
+static GLenum gl2__get_compressed_format(libqu_compression compression)
+{
+    switch (compression) {
+    case LIBQU_COMPRESSION_DXT1:
+        return g_caps.texture_s3tc ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_INVALID_ENUM;
+    case LIBQU_COMPRESSION_DXT1A:
+        return g_caps.texture_s3tc ? GL_COMPRESSED_RGBA_S3TC_DXT1_EXT : GL_INVALID_ENUM;
+    case LIBQU_COMPRESSION_DXT3:
+        return g_caps.texture_s3tc ? GL_COMPRESSED_RGBA_S3TC_DXT3_EXT : GL_INVALID_ENUM;
+    case LIBQU_COMPRESSION_DXT5:
+        return g_caps.texture_s3tc ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_INVALID_ENUM;
+    case LIBQU_COMPRESSION_ETC1:
+        // ETC2 decoders can read ETC1 data as well.
+        if (g_caps.texture_etc1) {
+            return GL_ETC1_RGB8_OES;
+        }
+
+        return g_caps.texture_etc2 ? GL_COMPRESSED_RGB8_ETC2 : GL_INVALID_ENUM;
+    case LIBQU_COMPRESSION_ETC2:
+        return g_caps.texture_etc2 ? GL_COMPRESSED_RGB8_ETC2 : GL_INVALID_ENUM;
+    case LIBQU_COMPRESSION_ETC2_EAC:
+        return g_caps.texture_etc2 ? GL_COMPRESSED_RGBA8_ETC2_EAC : GL_INVALID_ENUM;
+    default:
+        return GL_INVALID_ENUM;
+    }
+}
+
+/**
+ * Number of levels in a complete mipmap chain.
+ */
+static int gl2__get_full_level_count(int width, int height)
+{
+    int count = 1;
+
+    for (int size = QU_MAX(width, height); size > 1; size /= 2) {
+        count++;
+    }
+
+    return count;
+}
+
+static bool gl2__is_mipmap_filter(GLenum filter)
+{
+    return filter != GL_NEAREST && filter != GL_LINEAR;
+}
+
 static void gl2__texture_dtor(void *data)
 {
     gl2__texture *texture = data;
+
+    if (texture->job) {
+        libqu_cancel_image_job(texture->job);
+        return;
+    }
+
+    if (texture->atlas_id) {
+        gl2__atlas_page *page = &g_atlas.pages[texture->atlas_page];
+
+        // Packed area of an unused page can be reused from scratch.
+        if (--page->refs == 0) {
+            page->skyline[0] = (gl2__skyline_node) { 0, 0, g_atlas.page_size };
+            page->skyline_count = 1;
+        }
+
+        return;
+    }
+
     glDeleteTextures(1, &texture->handle);
 }
 
+static void gl2__tilemap_dtor(void *data)
+{
+    gl2__tilemap *tilemap = data;
+    int chunk_count = tilemap->chunk_columns * tilemap->chunk_rows;
+
+    for (int i = 0; i < chunk_count; i++) {
+        if (tilemap->chunks[i].vbo) {
+            glDeleteBuffers(1, &tilemap->chunks[i].vbo);
+        }
+    }
+
+    free(tilemap->chunks);
+    free(tilemap->tiles);
+}
+
+static void gl2__mesh_dtor(void *data)
+{
+    gl2__mesh *mesh = data;
+
+    for (int i = 0; i < GL2__VF_TOTAL; i++) {
+        if (mesh->vbo[i]) {
+            glDeleteBuffers(1, &mesh->vbo[i]);
+        }
+
+        free(mesh->vertices[i]);
+    }
+
+    free(mesh->commands.data);
+    free(mesh->draws);
+    free(mesh->rects);
+}
+
+static void gl2__free_cmd_list(gl2__cmd_list *list)
+{
+    free(list->commands.data);
+
+    for (int i = 0; i < GL2__VF_TOTAL; i++) {
+        free(list->vertices[i].array);
+    }
+
+    free(list->rects.array);
+}
+
+static void gl2__cmd_list_dtor(void *data)
+{
+    gl2__cmd_list *list = *(gl2__cmd_list **) data;
+
+    gl2__free_cmd_list(list);
+    free(list);
+}
+
 static void gl2__surface_dtor(void *data)
 {
     gl2__surface *surface = data;
@@ -281,32 +908,71 @@ static void gl2__surface_dtor(void *data)
     glDeleteRenderbuffers(1, &surface->depth);
 }
 
-static GLuint gl2__load_shader(gl2__shader_desc *desc)
+/**
+ * Call `load` for each OpenGL extension reported by the driver.
+ */
+static void gl2__load_extensions(void (*load)(char const *extension))
+{
+    char *extensions = qu_strdup((char const *) glGetString(GL_EXTENSIONS));
+
+    if (!extensions) {
+        return;
+    }
+
+    libqu_info("Supported OpenGL extensions:\n");
+    libqu_info("%s\n", extensions);
+
+    char *token = strtok(extensions, " ");
+    int count = 0;
+
+    while (token) {
+        load(token);
+        token = strtok(NULL, " ");
+        count++;
+    }
+
+    libqu_info("Total OpenGL extensions: %d\n", count);
+
+    free(extensions);
+}
+
+/**
+ * Start compiling the shader. Status is checked separately, so that
+ * drivers can compile several shaders in parallel.
+ */
+static GLuint gl2__compile_shader(gl2__shader_desc const *desc)
 {
     GLuint shader = glCreateShader(desc->type);
     glShaderSource(shader, 1, (GLchar const *const *) &desc->source, NULL);
     glCompileShader(shader);
 
+    return shader;
+}
+
+static bool gl2__check_shader(GLuint shader, gl2__shader_desc const *desc)
+{
     GLint success;
     glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
 
     if (!success) {
         char buffer[256];
         glGetShaderInfoLog(shader, 256, NULL, buffer);
-        glDeleteShader(shader);
 
         libqu_error("Failed to compile GLSL shader %s. Reason:\n%s\n",
                     desc->ident, buffer);
 
-        return 0;
+        return false;
     }
 
     libqu_info("Shader %s is compiled successfully.\n", desc->ident);
 
-    return shader;
+    return true;
 }
 
-static GLuint gl2__build_program(char const *ident, GLuint vs, GLuint fs)
+/**
+ * Start linking the program, status is checked separately.
+ */
+static GLuint gl2__link_program(GLuint vs, GLuint fs)
 {
     GLuint program = glCreateProgram();
 
@@ -317,49 +983,301 @@ static GLuint gl2__build_program(char const *ident, GLuint vs, GLuint fs)
         glBindAttribLocation(program, j, s_attr_names[j]);
     }
 
+    if (g_caps.program_binary) {
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
     glLinkProgram(program);
 
+    return program;
+}
+
+static bool gl2__check_program(GLuint program, char const *ident)
+{
     GLint success;
     glGetProgramiv(program, GL_LINK_STATUS, &success);
 
     if (!success) {
         char buffer[256];
         glGetProgramInfoLog(program, 256, NULL, buffer);
-        glDeleteProgram(program);
 
         libqu_error("Failed to link GLSL program %s: %s\n", ident, buffer);
 
-        return 0;
+        return false;
     }
 
     libqu_info("Shader program %s is compiled successfully.\n", ident);
 
-    return program;
+    return true;
 }
 
-//------------------------------------------------------------------------------
-
-static void gl2__upd_canvas_coords(int w_display, int h_display)
+/**
+ * Build all programs from GLSL sources.
+ */
+static bool gl2__compile_programs(void)
 {
-    struct surface *canvas = libqu_array_get(g_surfaces, g_state.canvas_id);
+    if (g_caps.parallel_compile) {
+        // Let the driver choose number of threads.
+        glMaxShaderCompilerThreads(0xFFFFFFFF);
+    }
 
-    float ard = g_state.display_aspect;
-    float arc = g_state.canvas_aspect;
+    GLuint shaders[GL2__SHADER_TOTAL];
 
-    if (ard > arc) {
-        g_state.canvas_ax = (w_display / 2.f) - ((arc / ard) * w_display / 2.f);
-        g_state.canvas_ay = 0.f;
-        g_state.canvas_bx = (w_display / 2.f) + ((arc / ard) * w_display / 2.f);
-        g_state.canvas_by = h_display;
-    } else {
-        g_state.canvas_ax = 0.f;
-        g_state.canvas_ay = (h_display / 2.f) - ((ard / arc) * h_display / 2.f);
-        g_state.canvas_bx = w_display;
-        g_state.canvas_by = (h_display / 2.f) + ((ard / arc) * h_display / 2.f);
+    for (int i = 0; i < GL2__SHADER_TOTAL; i++) {
+        shaders[i] = gl2__compile_shader(&s_shaders[i]);
     }
-}
 
-//------------------------------------------------------------------------------
+    for (int i = 0; i < GL2__PROG_TOTAL; i++) {
+        g_progs[i].handle = gl2__link_program(shaders[s_progs[i].vs],
+                                              shaders[s_progs[i].fs]);
+    }
+
+    // Nothing is queried until everything is submitted, so compilation
+    // and linking may proceed in background.
+    bool success = true;
+
+    for (int i = 0; i < GL2__SHADER_TOTAL; i++) {
+        success = gl2__check_shader(shaders[i], &s_shaders[i]) && success;
+    }
+
+    for (int i = 0; i < GL2__PROG_TOTAL; i++) {
+        success = gl2__check_program(g_progs[i].handle, s_progs[i].ident) && success;
+    }
+
+    for (int i = 0; i < GL2__SHADER_TOTAL; i++) {
+        glDeleteShader(shaders[i]);
+    }
+
+    return success;
+}
+
+//------------------------------------------------------------------------------
+// Program binary cache
+
+#define GL2__PROGRAM_CACHE_VERSION      (1)
+
+// Larger binaries in the cache are taken as a sign of a damaged file.
+#define GL2__PROGRAM_BINARY_MAX_SIZE    (16 * 1024 * 1024)
+
+// Cache file starts with this header, followed by format, length and
+// binary of every program in order of s_progs.
+typedef struct
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint32_t count;
+    uint32_t reserved;
+} gl2__program_cache_header;
+
+static uint64_t gl2__hash_string(uint64_t hash, char const *str)
+{
+    // FNV-1a, including the terminating zero
+    do {
+        hash ^= (unsigned char) *str;
+        hash *= 0x100000001B3ull;
+    } while (*str++);
+
+    return hash;
+}
+
+/**
+ * Binaries are only valid for the same driver and the same sources.
+ */
+static uint64_t gl2__get_program_cache_key(void)
+{
+    char const *strings[] = {
+        (char const *) glGetString(GL_VENDOR),
+        (char const *) glGetString(GL_RENDERER),
+        (char const *) glGetString(GL_VERSION),
+    };
+
+    uint64_t hash = 0xCBF29CE484222325ull;
+
+    for (size_t i = 0; i < sizeof(strings) / sizeof(strings[0]); i++) {
+        hash = gl2__hash_string(hash, strings[i] ? strings[i] : "");
+    }
+
+    for (int i = 0; i < GL2__SHADER_TOTAL; i++) {
+        hash = gl2__hash_string(hash, s_shaders[i].source);
+    }
+
+    for (int i = 0; i < GL2__ATTR_TOTAL; i++) {
+        hash = gl2__hash_string(hash, s_attr_names[i]);
+    }
+
+    return hash;
+}
+
+static bool gl2__load_program_cache(char const *path, uint64_t key)
+{
+    FILE *file = fopen(path, "rb");
+
+    if (!file) {
+        return false;
+    }
+
+    // Lengths read from the file are checked against its size.
+    long remaining = -1;
+
+    if (fseek(file, 0, SEEK_END) == 0) {
+        remaining = ftell(file);
+    }
+
+    gl2__program_cache_header header;
+    bool success = (remaining >= 0) && (fseek(file, 0, SEEK_SET) == 0)
+        && (fread(&header, sizeof(header), 1, file) == 1)
+        && memcmp(header.magic, "QUPB", 4) == 0
+        && header.version == GL2__PROGRAM_CACHE_VERSION
+        && header.key == key
+        && header.count == GL2__PROG_TOTAL;
+
+    int count = 0;
+
+    if (success) {
+        remaining -= sizeof(header);
+    }
+
+    while (success && count < GL2__PROG_TOTAL) {
+        uint32_t info[2];
+
+        if (fread(info, sizeof(info), 1, file) != 1) {
+            success = false;
+            break;
+        }
+
+        remaining -= sizeof(info);
+
+        if (info[1] == 0 || info[1] > GL2__PROGRAM_BINARY_MAX_SIZE
+            || info[1] > (unsigned long) remaining) {
+            success = false;
+            break;
+        }
+
+        remaining -= info[1];
+
+        void *binary = malloc(info[1]);
+
+        if (!binary || fread(binary, info[1], 1, file) != 1) {
+            free(binary);
+            success = false;
+            break;
+        }
+
+        GLuint program = glCreateProgram();
+        glProgramBinary(program, info[0], binary, info[1]);
+        free(binary);
+
+        GLint status;
+        glGetProgramiv(program, GL_LINK_STATUS, &status);
+
+        if (!status) {
+            glDeleteProgram(program);
+            success = false;
+            break;
+        }
+
+        g_progs[count++].handle = program;
+    }
+
+    fclose(file);
+
+    // Anything after the last program means the file isn't ours.
+    if (success && remaining != 0) {
+        success = false;
+    }
+
+    if (!success) {
+        for (int i = 0; i < count; i++) {
+            glDeleteProgram(g_progs[i].handle);
+            g_progs[i].handle = 0;
+        }
+
+        libqu_info("Shader cache %s doesn't match, compiling shaders.\n", path);
+        return false;
+    }
+
+    libqu_info("Loaded shader programs from cache %s.\n", path);
+
+    return true;
+}
+
+static void gl2__save_program_cache(char const *path, uint64_t key)
+{
+    FILE *file = fopen(path, "wb");
+
+    if (!file) {
+        libqu_warning("Can't write shader cache %s.\n", path);
+        return;
+    }
+
+    gl2__program_cache_header header = {
+        .magic = { 'Q', 'U', 'P', 'B' },
+        .version = GL2__PROGRAM_CACHE_VERSION,
+        .key = key,
+        .count = GL2__PROG_TOTAL,
+    };
+
+    bool success = (fwrite(&header, sizeof(header), 1, file) == 1);
+
+    for (int i = 0; success && i < GL2__PROG_TOTAL; i++) {
+        GLint length = 0;
+        glGetProgramiv(g_progs[i].handle, GL_PROGRAM_BINARY_LENGTH, &length);
+
+        void *binary = (length > 0) ? malloc(length) : NULL;
+
+        if (!binary) {
+            success = false;
+            break;
+        }
+
+        GLenum format;
+        glGetProgramBinary(g_progs[i].handle, length, &length, &format, binary);
+
+        uint32_t info[2] = { format, (uint32_t) length };
+
+        success = (length > 0)
+            && fwrite(info, sizeof(info), 1, file) == 1
+            && fwrite(binary, length, 1, file) == 1;
+
+        free(binary);
+    }
+
+    fclose(file);
+
+    if (!success) {
+        // Incomplete cache would be rejected anyway.
+        remove(path);
+        libqu_warning("Failed to write shader cache %s.\n", path);
+        return;
+    }
+
+    libqu_info("Saved shader programs to cache %s.\n", path);
+}
+
+//------------------------------------------------------------------------------
+
+static void gl2__upd_canvas_coords(int w_display, int h_display)
+{
+    struct surface *canvas = libqu_array_get(g_surfaces, g_state.canvas_id);
+
+    float ard = g_state.display_aspect;
+    float arc = g_state.canvas_aspect;
+
+    if (ard > arc) {
+        g_state.canvas_ax = (w_display / 2.f) - ((arc / ard) * w_display / 2.f);
+        g_state.canvas_ay = 0.f;
+        g_state.canvas_bx = (w_display / 2.f) + ((arc / ard) * w_display / 2.f);
+        g_state.canvas_by = h_display;
+    } else {
+        g_state.canvas_ax = 0.f;
+        g_state.canvas_ay = (h_display / 2.f) - ((ard / arc) * h_display / 2.f);
+        g_state.canvas_bx = w_display;
+        g_state.canvas_by = (h_display / 2.f) + ((ard / arc) * h_display / 2.f);
+    }
+}
+
+//------------------------------------------------------------------------------
 
 static void gl2__upload_uniform(int uniform, GLuint location)
 {
@@ -456,38 +1374,73 @@ static void gl2__upd_program(int program)
     g_state.program = program;
 }
 
-static void gl2__upd_vertex_format(int format)
+static void gl2__upd_attr_divisor(int attr, GLuint divisor)
 {
-    if (g_state.vertex_format == format) {
+    if (!g_caps.instanced_arrays || g_state.divisors[attr] == divisor) {
         return;
     }
 
-    int mask = s_vf_masks[format];
-
-    glBindBuffer(GL_ARRAY_BUFFER, g_vertex_bufs[format].vbo);
+    glVertexAttribDivisor(attr, divisor);
+    g_state.divisors[attr] = divisor;
+}
 
-    GLsizei stride = 0;
+/**
+ * Point attributes of the format to the bound GL_ARRAY_BUFFER,
+ * starting from `offset` bytes.
+ */
+static void gl2__set_attr_pointers(int format, GLsizeiptr offset)
+{
+    gl2__attr_format const *attrs = s_vf_attrs[format];
+    GLsizei stride = g_vertex_bufs[format].stride;
 
     for (int i = 0; i < GL2__ATTR_TOTAL; i++) {
-        if (mask & (1 << i)) {
+        if (attrs[i].size) {
             glEnableVertexAttribArray(i);
-            stride += sizeof(GLfloat) * s_attr_sizes[i];
+            glVertexAttribPointer(i, attrs[i].size, attrs[i].type,
+                                  attrs[i].normalized, stride,
+                                  (void *) offset);
+            gl2__upd_attr_divisor(i, attrs[i].divisor);
+            offset += gl2__get_attr_size(&attrs[i]);
         } else {
             glDisableVertexAttribArray(i);
         }
     }
+}
 
-    GLsizei offset = 0;
+static void gl2__upd_vertex_format(int format, int base)
+{
+    if (g_state.vertex_format == format && g_state.vertex_base == base) {
+        return;
+    }
 
-    for (int i = 0; i < GL2__ATTR_TOTAL; i++) {
-        if (mask & (1 << i)) {
-            glVertexAttribPointer(i, s_attr_sizes[i], GL_FLOAT,
-                                  GL_FALSE, stride, (void *) offset);
-            offset += sizeof(GLfloat) * s_attr_sizes[i];
-        }
+    gl2__attr_format const *attrs = s_vf_attrs[format];
+    gl2__vertex_buf *buffer = &g_vertex_bufs[format];
+
+    if (g_state.mesh_vbos) {
+        glBindBuffer(GL_ARRAY_BUFFER, g_state.mesh_vbos[format]);
+    } else {
+        glBindBuffer(GL_ARRAY_BUFFER, buffer->vbo[buffer->vbo_index]);
+    }
+
+    // Attribute pointers may start at arbitrary vertex,
+    // that's how indexed draws address vertices above 65535.
+    gl2__set_attr_pointers(format, base * buffer->stride);
+
+    // Sprite instances are expanded from corners of the unit quad.
+    if (format == GL2__VF_SPRITE) {
+        glBindBuffer(GL_ARRAY_BUFFER, g_unit_quad_vbo);
+        glEnableVertexAttribArray(GL2__ATTR_POSITION);
+        glVertexAttribPointer(GL2__ATTR_POSITION, 2, GL_FLOAT, GL_FALSE, 0, 0);
+        gl2__upd_attr_divisor(GL2__ATTR_POSITION, 0);
+    }
+
+    // Formats without per-vertex color are drawn in plain white.
+    if (!attrs[GL2__ATTR_COLOR].size) {
+        glVertexAttrib4f(GL2__ATTR_COLOR, 1.f, 1.f, 1.f, 1.f);
     }
 
     g_state.vertex_format = format;
+    g_state.vertex_base = base;
 }
 
 static void gl2__upd_texture(int32_t id)
@@ -561,7 +1514,17 @@ static void gl2__exec_clear(qu_color color)
 {
     gl2__upd_clear_color(color);
 
-    glClear(GL_COLOR_BUFFER_BIT);
+    GLbitfield mask = GL_COLOR_BUFFER_BIT;
+
+    if (g_state.surface_id != 0) {
+        gl2__surface *surface = libqu_array_get(g_surfaces, g_state.surface_id);
+
+        if (surface && surface->depth) {
+            mask |= GL_DEPTH_BUFFER_BIT;
+        }
+    }
+
+    glClear(mask);
 }
 
 static void gl2__exec_draw(qu_color color, int32_t texture, int program, int format,
@@ -570,9 +1533,64 @@ static void gl2__exec_draw(qu_color color, int32_t texture, int program, int for
     gl2__upd_draw_color(color);
     gl2__upd_texture(texture);
     gl2__upd_program(program);
-    gl2__upd_vertex_format(format);
 
-    glDrawArrays(mode, first, count);
+    if (g_state.vertex_format != format || g_state.vertex_base > first) {
+        gl2__upd_vertex_format(format, 0);
+    }
+
+    glDrawArrays(mode, first - g_state.vertex_base, count);
+
+    g_state.stats.draw_calls++;
+}
+
+/**
+ * Draw `count` vertices starting from `first` as a list of quads,
+ * using the shared quad index buffer.
+ */
+static void gl2__exec_draw_quads(qu_color color, int32_t texture, int program,
+                                 int format, GLint first, GLsizei count)
+{
+    gl2__upd_draw_color(color);
+    gl2__upd_texture(texture);
+    gl2__upd_program(program);
+
+    int const max_vertices = GL2__MAX_QUADS * 4;
+
+    for (int offset = 0; offset < count; offset += max_vertices) {
+        int vertex = first + offset;
+        int total = QU_MIN(count - offset, max_vertices);
+        int relative = vertex - g_state.vertex_base;
+
+        // Avoid moving attribute pointers while
+        // the quads are within range of the index buffer.
+        if (g_state.vertex_format != format || relative < 0 ||
+            (relative % 4) != 0 || (relative + total) > max_vertices) {
+            gl2__upd_vertex_format(format, vertex);
+            relative = 0;
+        }
+
+        glDrawElements(GL_TRIANGLES, (total / 4) * 6, GL_UNSIGNED_SHORT,
+                       (void *) ((relative / 4) * 6 * sizeof(GLushort)));
+
+        g_state.stats.draw_calls++;
+    }
+}
+
+/**
+ * Draw `count` sprite instances starting from `first`
+ * as instances of the unit quad.
+ */
+static void gl2__exec_draw_instanced(qu_color color, int32_t texture, int program,
+                                     int format, GLint first, GLsizei count)
+{
+    gl2__upd_draw_color(color);
+    gl2__upd_texture(texture);
+    gl2__upd_program(program);
+    gl2__upd_vertex_format(format, first);
+
+    glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0, count);
+
+    g_state.stats.draw_calls++;
 }
 
 static void gl2__exec_set_surface(int32_t id)
@@ -615,27 +1633,41 @@ static void gl2__exec_reset_view(void)
     gl2__upd_projection(width / 2.f, height / 2.f, width, height, 0.f);
 }
 
-static void gl2__exec_push_matrix(void)
+static bool gl2__push_matrix(qu_mat4 *stack, int *current)
 {
-    if (g_state.current_matrix == (GL2__MAX_MATRICES - 1)) {
+    if (*current == (GL2__MAX_MATRICES - 1)) {
         libqu_warning("Can't qu_push_matrix(): limit of %d matrices reached.\n", GL2__MAX_MATRICES);
-        return;
+        return false;
     }
 
-    qu_mat4_copy(&g_state.matrix[g_state.current_matrix + 1],
-                 &g_state.matrix[g_state.current_matrix]);
+    qu_mat4_copy(&stack[*current + 1], &stack[*current]);
+    (*current)++;
 
-    g_state.current_matrix++;
+    return true;
 }
 
-static void gl2__exec_pop_matrix(void)
+static bool gl2__pop_matrix(int *current)
 {
-    if (g_state.current_matrix == 0) {
+    if (*current == 0) {
         libqu_warning("Can't qu_pop_matrix(): already at the first matrix.\n");
-        return;
+        return false;
     }
 
-    g_state.current_matrix--;
+    (*current)--;
+
+    return true;
+}
+
+static void gl2__exec_push_matrix(void)
+{
+    gl2__push_matrix(g_state.matrix, &g_state.current_matrix);
+}
+
+static void gl2__exec_pop_matrix(void)
+{
+    if (gl2__pop_matrix(&g_state.current_matrix)) {
+        gl2__upd_model_view();
+    }
 }
 
 static void gl2__exec_translate(float x, float y)
@@ -657,6 +1689,83 @@ static void gl2__exec_rotate(float degrees)
     gl2__upd_model_view();
 }
 
+/**
+ * Draw chunks of the tilemap which are visible in the current view.
+ * Chunk bounds are transformed to clip space and tested against it.
+ */
+static void gl2__exec_draw_tilemap(int32_t id, int32_t texture, qu_mat4 const *matrix)
+{
+    gl2__tilemap *tilemap = libqu_array_get(g_tilemaps, id);
+
+    if (!tilemap || !gl2__push_matrix(g_state.matrix, &g_state.current_matrix)) {
+        return;
+    }
+
+    qu_mat4_multiply(&g_state.matrix[g_state.current_matrix], matrix);
+    gl2__upd_model_view();
+
+    qu_mat4 mvp;
+    qu_mat4_copy(&mvp, &g_state.projection);
+    qu_mat4_multiply(&mvp, &g_state.matrix[g_state.current_matrix]);
+
+    gl2__upd_draw_color(0xffffffff);
+    gl2__upd_texture(texture);
+    gl2__upd_program(GL2__PROG_TEXTURE);
+
+    float chunk_w = GL2__TILEMAP_CHUNK_SIZE * tilemap->tile_width;
+    float chunk_h = GL2__TILEMAP_CHUNK_SIZE * tilemap->tile_height;
+
+    for (int row = 0; row < tilemap->chunk_rows; row++) {
+        for (int column = 0; column < tilemap->chunk_columns; column++) {
+            gl2__tilemap_chunk *chunk =
+                &tilemap->chunks[row * tilemap->chunk_columns + column];
+
+            if (!chunk->vbo || chunk->quad_count == 0) {
+                continue;
+            }
+
+            float corners[] = {
+                column * chunk_w,       row * chunk_h,
+                (column + 1) * chunk_w, row * chunk_h,
+                (column + 1) * chunk_w, (row + 1) * chunk_h,
+                column * chunk_w,       (row + 1) * chunk_h,
+            };
+
+            float const *m = mvp.m;
+            float l = INFINITY, r = -INFINITY, t = INFINITY, b = -INFINITY;
+
+            for (int i = 0; i < 4; i++) {
+                float x = corners[2 * i + 0];
+                float y = corners[2 * i + 1];
+                float cx = m[0] * x + m[4] * y + m[12];
+                float cy = m[1] * x + m[5] * y + m[13];
+
+                l = QU_MIN(l, cx);
+                r = QU_MAX(r, cx);
+                t = QU_MIN(t, cy);
+                b = QU_MAX(b, cy);
+            }
+
+            if (r < -1.f || l > 1.f || b < -1.f || t > 1.f) {
+                continue;
+            }
+
+            glBindBuffer(GL_ARRAY_BUFFER, chunk->vbo);
+            gl2__set_attr_pointers(GL2__VF_TEXTURED_COLORED, 0);
+
+            glDrawElements(GL_TRIANGLES, chunk->quad_count * 6,
+                           GL_UNSIGNED_SHORT, (void *) 0);
+
+            g_state.stats.draw_calls++;
+        }
+    }
+
+    // Attribute pointers no longer refer to the frame VBO.
+    g_state.vertex_format = -1;
+
+    gl2__exec_pop_matrix();
+}
+
 static void gl2__exec_resize(int width, int height)
 {
     g_state.display_width = width;
@@ -676,53 +1785,127 @@ static void gl2__exec_resize(int width, int height)
 //------------------------------------------------------------------------------
 // Command buffer
 
-static void gl2__append_command(gl2__cmd const *command)
+#define GL2__CMD_RECORD_SIZE(type) \
+    ((sizeof(gl2__cmd_header) + s_cmd_sizes[(type)] + 7) & ~7u)
+
+#define GL2__CMD_PAYLOAD(header) \
+    ((void *) ((gl2__cmd_header *) (header) + 1))
+
+/**
+ * Get the list where the current thread records commands: either its
+ * own command list, or the frame.
+ */
+static gl2__cmd_list *gl2__get_record_list(void)
 {
-    gl2__cmd_buf *buffer = &g_cmd_buf;
+    return t_cmd_list ? t_cmd_list : g_record_frame;
+}
 
-    if (buffer->size == buffer->capacity) {
-        unsigned int next_capacity = buffer->capacity * 2;
+/**
+ * Make sure the command buffer can hold `required` bytes.
+ */
+static bool gl2__reserve_commands(gl2__cmd_buf *buffer, unsigned int required)
+{
+    if (required <= buffer->capacity) {
+        return true;
+    }
 
-        if (!next_capacity) {
-            next_capacity = 256;
-        }
+    unsigned int next_capacity = buffer->capacity * 2;
 
-        gl2__cmd *next_array =
-            realloc(buffer->array, sizeof(gl2__cmd) * next_capacity);
+    if (!next_capacity) {
+        next_capacity = 4096;
+    }
 
-        if (!next_array) {
-            return;
-        }
+    while (next_capacity < required) {
+        next_capacity *= 2;
+    }
 
-        buffer->array = next_array;
-        buffer->capacity = next_capacity;
+    unsigned char *next_data = realloc(buffer->data, next_capacity);
+
+    if (!next_data) {
+        return false;
+    }
+
+    buffer->data = next_data;
+    buffer->capacity = next_capacity;
+
+    return true;
+}
+
+/**
+ * Append a record to the command buffer. `payload` must point to
+ * the payload structure of the command, or be NULL if it has none.
+ */
+static void gl2__append_command(int type, void const *payload)
+{
+    gl2__cmd_list *list = gl2__get_record_list();
+    gl2__cmd_buf *buffer = &list->commands;
+    unsigned int size = GL2__CMD_RECORD_SIZE(type);
+    unsigned int required = buffer->size + size;
+
+    if (!gl2__reserve_commands(buffer, required)) {
+        return;
+    }
+
+    gl2__cmd_header *header = (gl2__cmd_header *) (buffer->data + buffer->size);
+
+    header->type = type;
+    header->size = size;
+
+    if (payload) {
+        memcpy(GL2__CMD_PAYLOAD(header), payload, s_cmd_sizes[type]);
+    }
+
+    // Draw commands are placed on the current layer.
+    if (type == GL2__CMD_DRAW) {
+        ((gl2__cmd_draw *) GL2__CMD_PAYLOAD(header))->layer = list->layer;
+    } else if (type == GL2__CMD_DRAW_TILEMAP) {
+        ((gl2__cmd_tilemap *) GL2__CMD_PAYLOAD(header))->layer = list->layer;
+    } else if (type == GL2__CMD_DRAW_MESH) {
+        ((gl2__cmd_mesh *) GL2__CMD_PAYLOAD(header))->layer = list->layer;
+    } else if (type == GL2__CMD_CALL_LIST) {
+        list->calls++;
     }
 
-    memcpy(&buffer->array[buffer->size++], command, sizeof(gl2__cmd));
+    buffer->size = required;
+    buffer->count++;
 }
 
-static void gl2__execute_command(gl2__cmd *command)
+static void gl2__execute_command(int type, void const *payload)
 {
-    switch (command->type) {
-    case GL2__CMD_CLEAR:
-        gl2__exec_clear(command->clear.color);
+    switch (type) {
+    case GL2__CMD_CLEAR: {
+        gl2__cmd_clear const *clear = payload;
+        gl2__exec_clear(clear->color);
         break;
-    case GL2__CMD_DRAW:
-        gl2__exec_draw(command->draw.color, command->draw.texture_id,
-                  command->draw.program, command->draw.format,
-                  command->draw.mode, command->draw.first, command->draw.count);
+    }
+    case GL2__CMD_DRAW: {
+        gl2__cmd_draw const *draw = payload;
+
+        if (draw->instanced) {
+            gl2__exec_draw_instanced(draw->color, draw->texture_id, draw->program,
+                                     draw->format, draw->first, draw->count);
+        } else if (draw->indexed) {
+            gl2__exec_draw_quads(draw->color, draw->texture_id, draw->program,
+                                 draw->format, draw->first, draw->count);
+        } else {
+            gl2__exec_draw(draw->color, draw->texture_id, draw->program,
+                           draw->format, draw->mode, draw->first, draw->count);
+        }
         break;
-    case GL2__CMD_SET_SURFACE:
-        gl2__exec_set_surface(command->surface.id);
+    }
+    case GL2__CMD_SET_SURFACE: {
+        gl2__cmd_surface const *surface = payload;
+        gl2__exec_set_surface(surface->id);
         break;
+    }
     case GL2__CMD_RESET_SURFACE:
         gl2__exec_reset_surface();
         break;
-    case GL2__CMD_SET_VIEW:
-        gl2__exec_set_view(command->view.x, command->view.y,
-                      command->view.w, command->view.h,
-                      command->view.r);
+    case GL2__CMD_SET_VIEW: {
+        gl2__cmd_view const *view = payload;
+        gl2__exec_set_view(view->x, view->y, view->w, view->h, view->r);
         break;
+    }
     case GL2__CMD_RESET_VIEW:
         gl2__exec_reset_view();
         break;
@@ -732,660 +1915,4343 @@ static void gl2__execute_command(gl2__cmd *command)
     case GL2__CMD_POP_MATRIX:
         gl2__exec_pop_matrix();
         break;
-    case GL2__CMD_TRANSLATE:
-        gl2__exec_translate(command->view.x, command->view.y);
+    case GL2__CMD_TRANSLATE: {
+        gl2__cmd_vec2 const *translate = payload;
+        gl2__exec_translate(translate->x, translate->y);
+        break;
+    }
+    case GL2__CMD_SCALE: {
+        gl2__cmd_vec2 const *scale = payload;
+        gl2__exec_scale(scale->x, scale->y);
         break;
-    case GL2__CMD_SCALE:
-        gl2__exec_scale(command->view.x, command->view.y);
+    }
+    case GL2__CMD_ROTATE: {
+        gl2__cmd_rotate const *rotate = payload;
+        gl2__exec_rotate(rotate->degrees);
         break;
-    case GL2__CMD_ROTATE:
-        gl2__exec_rotate(command->view.r);
+    }
+    case GL2__CMD_RESIZE: {
+        gl2__cmd_resize const *resize = payload;
+        gl2__exec_resize(resize->w, resize->h);
         break;
-    case GL2__CMD_RESIZE:
-        gl2__exec_resize(command->size.w, command->size.h);
+    }
+    case GL2__CMD_DRAW_TILEMAP: {
+        gl2__cmd_tilemap const *tilemap = payload;
+        gl2__exec_draw_tilemap(tilemap->id, tilemap->texture_id, &tilemap->matrix);
         break;
+    }
     default:
         break;
     }
 }
 
-//------------------------------------------------------------------------------
-// Vertex buffer
-
-static int gl2__append_vertex_data(int format, float const *data, int size)
+/**
+ * Replay commands of the mesh with its VBOs as the vertex source.
+ * Transformations made by the mesh are undone afterwards.
+ */
+static void gl2__exec_draw_mesh(int32_t id, qu_mat4 const *matrix)
 {
-    gl2__vertex_buf *buffer = &g_vertex_bufs[format];
+    gl2__mesh *mesh = libqu_array_get(g_meshes, id);
 
-    unsigned int required = buffer->size + size;
+    if (!mesh || !gl2__push_matrix(g_state.matrix, &g_state.current_matrix)) {
+        return;
+    }
+
+    int current_matrix = g_state.current_matrix;
+
+    qu_mat4_multiply(&g_state.matrix[current_matrix], matrix);
+    gl2__upd_model_view();
+
+    g_state.mesh_vbos = mesh->vbo;
+    g_state.vertex_format = -1;
+
+    unsigned char *record = mesh->commands.data;
+    unsigned char *end = mesh->commands.data + mesh->commands.size;
+
+    while (record < end) {
+        gl2__cmd_header *header = (gl2__cmd_header *) record;
+
+        gl2__execute_command(header->type, GL2__CMD_PAYLOAD(header));
+        record += header->size;
+    }
+
+    g_state.mesh_vbos = NULL;
+    g_state.vertex_format = -1;
+
+    g_state.current_matrix = current_matrix;
+    gl2__exec_pop_matrix();
+}
+
+/**
+ * Decode and execute all records of the command buffer in order.
+ */
+static void gl2__execute_commands(void)
+{
+    gl2__cmd_buf *buffer = &g_render_frame->commands;
+
+    unsigned char *record = buffer->data;
+    unsigned char *end = buffer->data + buffer->size;
+
+    while (record < end) {
+        gl2__cmd_header *header = (gl2__cmd_header *) record;
+
+        if (header->type == GL2__CMD_DRAW_MESH) {
+            gl2__cmd_mesh const *mesh = GL2__CMD_PAYLOAD(header);
+            gl2__exec_draw_mesh(mesh->id, &mesh->matrix);
+        } else {
+            gl2__execute_command(header->type, GL2__CMD_PAYLOAD(header));
+        }
+
+        record += header->size;
+    }
+}
+
+//------------------------------------------------------------------------------
+// Batching
+
+static bool gl2__is_mergeable_mode(int mode)
+{
+    // Only independent primitives can be concatenated,
+    // strips, fans and loops can't.
+    return mode == GL_POINTS || mode == GL_LINES || mode == GL_TRIANGLES;
+}
+
+static bool gl2__can_merge_draws(gl2__cmd_draw const *a, gl2__cmd_draw const *b)
+{
+    if (a->mode != b->mode || !gl2__is_mergeable_mode(a->mode)) {
+        return false;
+    }
+
+    return a->color == b->color
+        && a->indexed == b->indexed
+        && a->instanced == b->instanced
+        && a->resolve == b->resolve
+        && a->texture_id == b->texture_id
+        && a->program == b->program
+        && a->format == b->format
+        && (a->first + a->count) == b->first;
+}
+
+/**
+ * Merge consecutive draw commands which share the same state and
+ * refer to adjacent vertex ranges. Order of commands is preserved.
+ * The command buffer is compacted in place.
+ * Returns number of draw commands before merging.
+ */
+static int gl2__batch_commands(gl2__cmd_buf *buffer)
+{
+    int draw_count = 0;
+
+    unsigned char *src = buffer->data;
+    unsigned char *dst = buffer->data;
+    unsigned char *end = buffer->data + buffer->size;
+
+    gl2__cmd_draw *last_draw = NULL;
+    unsigned int count = 0;
+
+    while (src < end) {
+        gl2__cmd_header *header = (gl2__cmd_header *) src;
+        uint32_t type = header->type;
+        unsigned int size = header->size;
+
+        if (type == GL2__CMD_DRAW) {
+            gl2__cmd_draw const *draw = GL2__CMD_PAYLOAD(header);
+
+            draw_count++;
+
+            if (last_draw && gl2__can_merge_draws(last_draw, draw)) {
+                last_draw->count += draw->count;
+                src += size;
+                continue;
+            }
+        }
+
+        if (dst != src) {
+            memmove(dst, src, size);
+        }
+
+        if (type == GL2__CMD_DRAW) {
+            last_draw = GL2__CMD_PAYLOAD(dst);
+        } else {
+            last_draw = NULL;
+        }
+
+        src += size;
+        dst += size;
+        count++;
+    }
+
+    buffer->size = dst - buffer->data;
+    buffer->count = count;
+
+    return draw_count;
+}
+
+//------------------------------------------------------------------------------
+// Sorting
+
+static bool gl2__reserve_sort_buf(unsigned int count, unsigned int size)
+{
+    gl2__sort_buf *buffer = &g_sort_buf;
+
+    if (count > buffer->capacity) {
+        for (int i = 0; i < 2; i++) {
+            gl2__sort_item *next_items =
+                realloc(buffer->items[i], sizeof(gl2__sort_item) * count);
+
+            if (!next_items) {
+                return false;
+            }
+
+            buffer->items[i] = next_items;
+        }
+
+        buffer->capacity = count;
+    }
+
+    if (size > buffer->data_capacity) {
+        unsigned char *next_data = realloc(buffer->data, size);
+
+        if (!next_data) {
+            return false;
+        }
+
+        buffer->data = next_data;
+        buffer->data_capacity = size;
+    }
+
+    return true;
+}
+
+/**
+ * Build sort key of each command. Upper 32 bits hold index of the
+ * segment: any command other than draw is a barrier, which takes
+ * a segment of its own, so draws are never moved across it.
+ * Lower 32 bits hold layer of draw commands, biased to sort
+ * negative layers first.
+ */
+static void gl2__build_sort_keys(gl2__sort_item *items)
+{
+    gl2__cmd_buf *buffer = &g_render_frame->commands;
+
+    uint64_t segment = 0;
+    unsigned int offset = 0;
+
+    for (unsigned int i = 0; i < buffer->count; i++) {
+        gl2__cmd_header *header = (gl2__cmd_header *) (buffer->data + offset);
+
+        if (header->type == GL2__CMD_DRAW) {
+            gl2__cmd_draw const *draw = GL2__CMD_PAYLOAD(header);
+            uint32_t layer = (uint32_t) draw->layer ^ 0x80000000u;
+
+            items[i].key = (segment << 32) | layer;
+        } else if (header->type == GL2__CMD_DRAW_TILEMAP) {
+            // Tilemaps and meshes restore transformation they change,
+            // so they are moved between draws like one of them.
+            gl2__cmd_tilemap const *tilemap = GL2__CMD_PAYLOAD(header);
+            uint32_t layer = (uint32_t) tilemap->layer ^ 0x80000000u;
+
+            items[i].key = (segment << 32) | layer;
+        } else if (header->type == GL2__CMD_DRAW_MESH) {
+            gl2__cmd_mesh const *mesh = GL2__CMD_PAYLOAD(header);
+            uint32_t layer = (uint32_t) mesh->layer ^ 0x80000000u;
+
+            items[i].key = (segment << 32) | layer;
+        } else {
+            items[i].key = ++segment << 32;
+            segment++;
+        }
+
+        items[i].offset = offset;
+        offset += header->size;
+    }
+}
+
+/**
+ * Reorder draw commands by layer. Radix sort is stable,
+ * so commands on the same layer keep their submission order.
+ * Returns true if the order of commands has changed.
+ */
+static bool gl2__sort_commands(void)
+{
+    gl2__cmd_buf *buffer = &g_render_frame->commands;
+    unsigned int count = buffer->count;
+
+    if (!g_render_frame->layered || count < 2) {
+        return false;
+    }
+
+    if (!gl2__reserve_sort_buf(count, buffer->size)) {
+        return false;
+    }
+
+    gl2__sort_item *src = g_sort_buf.items[0];
+    gl2__sort_item *dst = g_sort_buf.items[1];
+
+    gl2__build_sort_keys(src);
+
+    for (int shift = 0; shift < 64; shift += 8) {
+        unsigned int offsets[256] = { 0 };
+
+        for (unsigned int i = 0; i < count; i++) {
+            offsets[(src[i].key >> shift) & 255]++;
+        }
+
+        // Skip the pass if all keys have the same digit.
+        if (offsets[(src[0].key >> shift) & 255] == count) {
+            continue;
+        }
+
+        unsigned int total = 0;
+
+        for (int i = 0; i < 256; i++) {
+            unsigned int digit_count = offsets[i];
+            offsets[i] = total;
+            total += digit_count;
+        }
+
+        for (unsigned int i = 0; i < count; i++) {
+            dst[offsets[(src[i].key >> shift) & 255]++] = src[i];
+        }
+
+        gl2__sort_item *temp = src;
+        src = dst;
+        dst = temp;
+    }
+
+    bool reordered = false;
+    unsigned int size = 0;
+
+    for (unsigned int i = 0; i < count; i++) {
+        gl2__cmd_header *header = (gl2__cmd_header *) (buffer->data + src[i].offset);
+
+        if (src[i].offset != size) {
+            reordered = true;
+        }
+
+        memcpy(g_sort_buf.data + size, header, header->size);
+        size += header->size;
+    }
+
+    if (reordered) {
+        memcpy(buffer->data, g_sort_buf.data, size);
+    }
+
+    return reordered;
+}
+
+//------------------------------------------------------------------------------
+// Vertex buffer
+
+/**
+ * Make sure the vertex array can hold `required` bytes.
+ */
+static bool gl2__reserve_vertices(gl2__vertex_array *buffer, unsigned int required)
+{
+    if (required <= buffer->capacity) {
+        return true;
+    }
+
+    unsigned int next_capacity = buffer->capacity;
+
+    if (next_capacity == 0) {
+        next_capacity = 1024;
+    }
+
+    while (next_capacity < required) {
+        next_capacity *= 2;
+    }
+
+    unsigned char *next_array = realloc(buffer->array, next_capacity);
+
+    if (!next_array) {
+        return false;
+    }
+
+    libqu_debug("GLES 2.0: grow vertex array [%d -> %d]\n",
+                buffer->capacity, next_capacity);
+
+    buffer->array = next_array;
+    buffer->capacity = next_capacity;
+
+    return true;
+}
+
+/**
+ * Reserve space for `count` vertices in the vertex buffer of given format.
+ * Returns pointer to the reserved space, or NULL on failure.
+ * Index of the first reserved vertex is written to `first`.
+ */
+static void *gl2__alloc_vertices(int format, int count, int *first)
+{
+    gl2__vertex_array *buffer = &gl2__get_record_list()->vertices[format];
+    unsigned int stride = g_vertex_bufs[format].stride;
+
+    unsigned int required = buffer->size + count * stride;
+
+    if (!gl2__reserve_vertices(buffer, required)) {
+        return NULL;
+    }
+
+    unsigned char *data = buffer->array + buffer->size;
+
+    *first = buffer->size / stride;
+    buffer->size = required;
+
+    return data;
+}
+
+/**
+ * Append `count` vertices already laid out in the given format.
+ * Returns index of the first appended vertex.
+ */
+static int gl2__append_vertices(int format, void const *data, int count)
+{
+    int first;
+    void *dst = gl2__alloc_vertices(format, count, &first);
+
+    if (!dst) {
+        return 0;
+    }
+
+    memcpy(dst, data, count * g_vertex_bufs[format].stride);
+
+    return first;
+}
+
+/**
+ * Transform positions of `count` vertices in place with the current
+ * record-time matrix. Position is the first attribute of every vertex,
+ * `stride` is the vertex size in bytes.
+ */
+static void gl2__bake_positions(void *data, int count, int stride)
+{
+    gl2__cmd_list *list = gl2__get_record_list();
+    float const *m = list->baked_matrix[list->baked_current_matrix].m;
+    unsigned char *vertex = data;
+
+    for (int i = 0; i < count; i++) {
+        GLfloat *position = (GLfloat *) vertex;
+
+        float x = position[0];
+        float y = position[1];
+
+        position[0] = m[0] * x + m[4] * y + m[12];
+        position[1] = m[1] * x + m[5] * y + m[13];
+
+        vertex += stride;
+    }
+}
+
+/**
+ * Append `count` vertices to the solid colored vertex buffer.
+ * `data` holds positions (x, y) of vertices.
+ * Returns index of the first appended vertex.
+ */
+static int gl2__append_solid_vertices(float const *data, int count, qu_color color)
+{
+    int first;
+    gl2__solid_vertex *dst =
+        gl2__alloc_vertices(GL2__VF_SOLID_COLORED, count, &first);
+
+    if (!dst) {
+        return 0;
+    }
+
+    GLubyte c[4];
+    gl2__pack_color(color, c);
+
+    for (int i = 0; i < count; i++) {
+        dst[i].x = data[2 * i + 0];
+        dst[i].y = data[2 * i + 1];
+        memcpy(dst[i].color, c, sizeof(c));
+    }
+
+    if (g_state.bake_transforms) {
+        gl2__bake_positions(dst, count, sizeof(gl2__solid_vertex));
+    }
+
+    return first;
+}
+
+/**
+ * Append `count` vertices to the textured colored vertex buffer.
+ * `data` holds positions and texture coordinates (x, y, s, t) of vertices.
+ * Texture coordinates are clamped to [0; 1].
+ * Returns index of the first appended vertex.
+ */
+static int gl2__append_textured_vertices(float const *data, int count, qu_color color)
+{
+    int first;
+    gl2__textured_vertex *dst =
+        gl2__alloc_vertices(GL2__VF_TEXTURED_COLORED, count, &first);
+
+    if (!dst) {
+        return 0;
+    }
+
+    GLubyte c[4];
+    gl2__pack_color(color, c);
+
+    for (int i = 0; i < count; i++) {
+        dst[i].x = data[4 * i + 0];
+        dst[i].y = data[4 * i + 1];
+        memcpy(dst[i].color, c, sizeof(c));
+        dst[i].s = gl2__pack_texcoord(data[4 * i + 2]);
+        dst[i].t = gl2__pack_texcoord(data[4 * i + 3]);
+    }
+
+    if (g_state.bake_transforms) {
+        gl2__bake_positions(dst, count, sizeof(gl2__textured_vertex));
+    }
+
+    return first;
+}
+
+/**
+ * Copy vertices of draw commands to the spare arrays in the order
+ * the commands are executed, so that the batching stage can merge
+ * draws which were adjacent in the sorted command buffer.
+ */
+static void gl2__repack_vertices(void)
+{
+    gl2__vertex_array *arrays = g_render_frame->vertices;
+
+    for (int i = 0; i < GL2__VF_TOTAL; i++) {
+        gl2__vertex_buf *buffer = &g_vertex_bufs[i];
+
+        if (buffer->spare_capacity < arrays[i].capacity) {
+            unsigned char *next_spare = realloc(buffer->spare, arrays[i].capacity);
+
+            if (!next_spare) {
+                return;
+            }
+
+            buffer->spare = next_spare;
+            buffer->spare_capacity = arrays[i].capacity;
+        }
+    }
+
+    unsigned int sizes[GL2__VF_TOTAL] = { 0 };
+
+    gl2__cmd_buf *commands = &g_render_frame->commands;
+    unsigned char *record = commands->data;
+    unsigned char *end = commands->data + commands->size;
+
+    for (; record < end; record += ((gl2__cmd_header *) record)->size) {
+        gl2__cmd_header *header = (gl2__cmd_header *) record;
+
+        if (header->type != GL2__CMD_DRAW) {
+            continue;
+        }
+
+        gl2__cmd_draw *draw = GL2__CMD_PAYLOAD(header);
+        gl2__vertex_buf *buffer = &g_vertex_bufs[draw->format];
+        unsigned int *size = &sizes[draw->format];
+        unsigned int length = draw->count * buffer->stride;
+
+        memcpy(buffer->spare + *size,
+               arrays[draw->format].array + draw->first * buffer->stride,
+               length);
+
+        draw->first = *size / buffer->stride;
+        *size += length;
+    }
+
+    for (int i = 0; i < GL2__VF_TOTAL; i++) {
+        gl2__vertex_buf *buffer = &g_vertex_bufs[i];
+
+        unsigned char *array = arrays[i].array;
+        unsigned int capacity = arrays[i].capacity;
+
+        arrays[i].array = buffer->spare;
+        arrays[i].capacity = buffer->spare_capacity;
+        arrays[i].size = sizes[i];
+
+        buffer->spare = array;
+        buffer->spare_capacity = capacity;
+    }
+}
+
+/**
+ * Upload contents of the vertex array to the next VBO in the ring.
+ */
+static void gl2__upload_vertex_buf(gl2__vertex_buf *buffer,
+                                   gl2__vertex_array const *vertices)
+{
+    buffer->vbo_index = (buffer->vbo_index + 1) % GL2__VBO_RING_SIZE;
+
+    int index = buffer->vbo_index;
+    GLsizeiptr size = vertices->size;
+
+    GLsync fence = buffer->fence[index];
+    buffer->fence[index] = NULL;
+
+    glBindBuffer(GL_ARRAY_BUFFER, buffer->vbo[index]);
+
+    // Allocate storage large enough for the whole CPU-side array,
+    // so it doesn't have to be reallocated every time it grows a bit.
+    if (size > buffer->vbo_size[index]) {
+        buffer->vbo_size[index] = vertices->capacity;
+
+        glBufferData(GL_ARRAY_BUFFER, buffer->vbo_size[index],
+                     NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, size, vertices->array);
+
+        if (fence) {
+            glDeleteSync(fence);
+        }
+
+        return;
+    }
+
+    if (g_caps.map_buffer_range) {
+        GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT;
+
+        // The frame this VBO was last used for may still be rendered.
+        // Once its fence is signaled, the driver doesn't have to check.
+        // Otherwise invalidation lets it give the mapping new storage.
+        if (fence) {
+            GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                             GL2__FENCE_TIMEOUT);
+
+            if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+                access |= GL_MAP_UNSYNCHRONIZED_BIT;
+            }
+        }
+
+        void *data = glMapBufferRange(GL_ARRAY_BUFFER, 0, size, access);
+
+        if (fence) {
+            glDeleteSync(fence);
+            fence = NULL;
+        }
+
+        if (data) {
+            memcpy(data, vertices->array, size);
+
+            if (glUnmapBuffer(GL_ARRAY_BUFFER)) {
+                return;
+            }
+        }
+    }
+
+    if (fence) {
+        glDeleteSync(fence);
+    }
+
+    // Orphan the old storage and fill the new one.
+    glBufferData(GL_ARRAY_BUFFER, buffer->vbo_size[index], NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, size, vertices->array);
+}
+
+//------------------------------------------------------------------------------
+// Frames
+
+/**
+ * Execute the frame pointed by `g_render_frame` and present it.
+ * The frame is left empty afterwards.
+ */
+static void gl2__render_frame(void)
+{
+    // Reorder draw commands by layer...
+    if (gl2__sort_commands()) {
+        gl2__repack_vertices();
+    }
+
+    // Upload vertex data to the GPU...
+    bool uploaded[GL2__VF_TOTAL] = {0};
+
+    for (int i = 0; i < GL2__VF_TOTAL; i++) {
+        gl2__vertex_array *vertices = &g_render_frame->vertices[i];
+
+        if (vertices->size == 0) {
+            continue;
+        }
+
+        gl2__upload_vertex_buf(&g_vertex_bufs[i], vertices);
+        vertices->size = 0;
+        uploaded[i] = true;
+    }
+
+    // Force VBO pointer update
+    g_state.vertex_format = -1;
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_quad_ibo);
+
+    // Just in case
+    glFlush();
+
+    // Reset statistics for the new frame
+    memset(&g_state.stats, 0, sizeof(g_state.stats));
+
+    // Merge compatible draw commands...
+    g_state.stats.draw_commands += gl2__batch_commands(&g_render_frame->commands);
+
+    // Execute all pending rendering commands...
+    gl2__execute_commands();
+
+    // VBOs of this frame can be overwritten once these are signaled
+    if (g_caps.sync) {
+        for (int i = 0; i < GL2__VF_TOTAL; i++) {
+            if (uploaded[i]) {
+                gl2__vertex_buf *buffer = &g_vertex_bufs[i];
+                buffer->fence[buffer->vbo_index] =
+                    glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            }
+        }
+    }
+
+    // Reset size of the command buffer to 0
+    g_render_frame->commands.size = 0;
+    g_render_frame->commands.count = 0;
+    g_render_frame->layered = false;
+
+    // Restore transformation stack
+    g_state.current_matrix = 0;
+    qu_mat4_identity(&g_state.matrix[0]);
+    gl2__upd_model_view();
+
+    libqu_gl_swap_buffers();
+}
+
+static intptr_t gl2__render_thread_main(void *arg)
+{
+    gl2__render_thread *rt = &g_render_thread;
+
+    libqu_lock_mutex(rt->mutex);
+
+    while (true) {
+        // Give the context away if the calling thread asks for it.
+        if (rt->context_request) {
+            if (rt->has_context) {
+                libqu_gl_make_current(false);
+                rt->has_context = false;
+                libqu_signal_cond(rt->cond);
+            }
+        } else if (rt->pending) {
+            rt->pending = false;
+            rt->busy = true;
+
+            if (!rt->has_context) {
+                libqu_gl_make_current(true);
+                rt->has_context = true;
+            }
+
+            libqu_unlock_mutex(rt->mutex);
+            gl2__render_frame();
+            libqu_lock_mutex(rt->mutex);
+
+            rt->busy = false;
+            rt->stats = g_state.stats;
+            libqu_signal_cond(rt->cond);
+            continue;
+        }
+
+        if (rt->quit) {
+            break;
+        }
+
+        libqu_wait_cond(rt->cond, rt->mutex);
+    }
+
+    if (rt->has_context) {
+        libqu_gl_make_current(false);
+        rt->has_context = false;
+    }
+
+    libqu_unlock_mutex(rt->mutex);
+
+    return 0;
+}
+
+static void gl2__start_render_thread(void)
+{
+    gl2__render_thread *rt = &g_render_thread;
+
+    if (!libqu_gl_make_current(false)) {
+        libqu_warning("Can't release OpenGL context, render thread is disabled.\n");
+        return;
+    }
+
+    // From now on frames are recorded and rendered in turns.
+    g_render_frame = &g_frames[1];
+
+    rt->mutex = libqu_create_mutex();
+    rt->cond = libqu_create_cond();
+
+    if (rt->mutex && rt->cond) {
+        rt->thread = libqu_create_thread("render", gl2__render_thread_main, NULL);
+    }
+
+    if (!rt->thread) {
+        libqu_destroy_cond(rt->cond);
+        libqu_destroy_mutex(rt->mutex);
+        libqu_gl_make_current(true);
+
+        g_render_frame = g_record_frame;
+
+        libqu_warning("Failed to start render thread.\n");
+        return;
+    }
+
+    libqu_info("Frames are rendered on a separate thread.\n");
+}
+
+static void gl2__stop_render_thread(void)
+{
+    gl2__render_thread *rt = &g_render_thread;
+
+    if (!rt->thread) {
+        return;
+    }
+
+    libqu_lock_mutex(rt->mutex);
+    rt->quit = true;
+    libqu_signal_cond(rt->cond);
+    libqu_unlock_mutex(rt->mutex);
+
+    libqu_wait_thread(rt->thread);
+    libqu_destroy_cond(rt->cond);
+    libqu_destroy_mutex(rt->mutex);
+
+    libqu_gl_make_current(true);
+
+    memset(rt, 0, sizeof(*rt));
+}
+
+/**
+ * Block until the render thread has no frame to render.
+ * Mutex should be locked.
+ */
+static void gl2__wait_render_thread(void)
+{
+    gl2__render_thread *rt = &g_render_thread;
+
+    while (rt->busy || rt->pending) {
+        libqu_wait_cond(rt->cond, rt->mutex);
+    }
+}
+
+/**
+ * Pass the frame pointed by `g_record_frame` to the render thread and
+ * start recording the other one. Waits until the previous frame is done.
+ */
+static void gl2__submit_frame(void)
+{
+    gl2__render_thread *rt = &g_render_thread;
+
+    libqu_lock_mutex(rt->mutex);
+    gl2__wait_render_thread();
+
+    gl2__cmd_list *frame = g_render_frame;
+    g_render_frame = g_record_frame;
+    g_record_frame = frame;
+
+    rt->pending = true;
+    libqu_signal_cond(rt->cond);
+
+    libqu_unlock_mutex(rt->mutex);
+}
+
+/**
+ * Textures and surfaces may be looked up by command lists recorded on
+ * other threads, so arrays holding them are only changed with this lock.
+ */
+static void gl2__lock_resources(void)
+{
+    if (g_resource_mutex) {
+        libqu_lock_mutex(g_resource_mutex);
+    }
+}
+
+static void gl2__unlock_resources(void)
+{
+    if (g_resource_mutex) {
+        libqu_unlock_mutex(g_resource_mutex);
+    }
+}
+
+/**
+ * Make the GL context current on the calling thread. Must be paired with
+ * gl2__release_context(). Textures and surfaces are locked until then.
+ * Only the lock is taken if there is no render thread.
+ */
+static void gl2__acquire_context(void)
+{
+    gl2__render_thread *rt = &g_render_thread;
+
+    if (t_context_depth++ > 0) {
+        return;
+    }
+
+    gl2__lock_resources();
+
+    if (!rt->thread) {
+        return;
+    }
+
+    libqu_lock_mutex(rt->mutex);
+    gl2__wait_render_thread();
+
+    rt->context_request = true;
+    libqu_signal_cond(rt->cond);
+
+    while (rt->has_context) {
+        libqu_wait_cond(rt->cond, rt->mutex);
+    }
+
+    libqu_unlock_mutex(rt->mutex);
+
+    libqu_gl_make_current(true);
+}
+
+static void gl2__release_context(void)
+{
+    gl2__render_thread *rt = &g_render_thread;
+
+    if (--t_context_depth > 0) {
+        return;
+    }
+
+    if (rt->thread) {
+        libqu_gl_make_current(false);
+
+        libqu_lock_mutex(rt->mutex);
+        rt->context_request = false;
+        libqu_signal_cond(rt->cond);
+        libqu_unlock_mutex(rt->mutex);
+    }
+
+    gl2__unlock_resources();
+}
+
+//------------------------------------------------------------------------------
+// Culling
+
+// Draws recorded into the frame are checked against the view they
+// will be executed with. The tracking mirrors gl2__upd_surface() and
+// view commands. Whenever the state can't be known (command lists,
+// matrix commands without baked transforms), nothing is culled.
+
+static void gl2__cull_set_view(float x, float y, float w, float h, float rotation)
+{
+    float hw = fabsf(w) / 2.f;
+    float hh = fabsf(h) / 2.f;
+
+    // Bounding box of the rotated view.
+    if (rotation != 0.f) {
+        float c = fabsf(cosf(QU_DEG2RAD(rotation)));
+        float s = fabsf(sinf(QU_DEG2RAD(rotation)));
+
+        float rw = c * hw + s * hh;
+        float rh = s * hw + c * hh;
+
+        hw = rw;
+        hh = rh;
+    }
+
+    g_cull.l = x - hw;
+    g_cull.r = x + hw;
+    g_cull.t = y - hh;
+    g_cull.b = y + hh;
+    g_cull.valid = true;
+}
+
+static void gl2__cull_reset_view(void)
+{
+    int width, height;
+
+    if (g_cull.surface_id < 0) {
+        g_cull.valid = false;
+        return;
+    } else if (g_cull.surface_id == 0) {
+        width = g_display.width;
+        height = g_display.height;
+    } else {
+        gl2__surface *surface = libqu_array_get(g_surfaces, g_cull.surface_id);
+
+        if (!surface) {
+            g_cull.valid = false;
+            return;
+        }
+
+        width = surface->width;
+        height = surface->height;
+    }
+
+    gl2__cull_set_view(width / 2.f, height / 2.f, width, height, 0.f);
+}
+
+static void gl2__cull_set_surface(int32_t id)
+{
+    if (g_cull.surface_id == id) {
+        return;
+    }
+
+    // Previous target is unknown, so is whether the view is reset.
+    if (g_cull.surface_id < 0) {
+        g_cull.surface_id = id;
+        g_cull.valid = false;
+        return;
+    }
+
+    g_cull.surface_id = id;
+    g_cull.transformed = false;
+    gl2__cull_reset_view();
+}
+
+static void gl2__cull_invalidate(void)
+{
+    g_cull.surface_id = -1;
+    g_cull.valid = false;
+    g_cull.transformed = true;
+}
+
+/**
+ * Check if the rectangle (in coordinates of the current transformation)
+ * may be visible. Returns true if it can't be decided.
+ */
+static bool gl2__is_visible(float x, float y, float w, float h)
+{
+    if (t_cmd_list || !g_cull.valid) {
+        return true;
+    }
+
+    float l = QU_MIN(x, x + w);
+    float r = QU_MAX(x, x + w);
+    float t = QU_MIN(y, y + h);
+    float b = QU_MAX(y, y + h);
+
+    if (g_state.bake_transforms) {
+        gl2__cmd_list *list = g_record_frame;
+        float const *m = list->baked_matrix[list->baked_current_matrix].m;
+        float corners[] = { l, t, r, t, r, b, l, b };
+
+        l = t = INFINITY;
+        r = b = -INFINITY;
+
+        for (int i = 0; i < 4; i++) {
+            float cx = corners[2 * i + 0];
+            float cy = corners[2 * i + 1];
+            float px = m[0] * cx + m[4] * cy + m[12];
+            float py = m[1] * cx + m[5] * cy + m[13];
+
+            l = QU_MIN(l, px);
+            r = QU_MAX(r, px);
+            t = QU_MIN(t, py);
+            b = QU_MAX(b, py);
+        }
+    } else if (g_cull.transformed) {
+        return true;
+    }
+
+    return r >= g_cull.l && l <= g_cull.r && b >= g_cull.t && t <= g_cull.b;
+}
+
+//------------------------------------------------------------------------------
+// Views
+
+static void gl2_set_view(float x, float y, float w, float h, float rotation)
+{
+    if (!t_cmd_list) {
+        gl2__cull_set_view(x, y, w, h, rotation);
+    }
+
+    gl2__append_command(GL2__CMD_SET_VIEW, &(gl2__cmd_view) {
+        .x = x,
+        .y = y,
+        .w = w,
+        .h = h,
+        .r = rotation,
+    });
+}
+
+static void gl2_reset_view(void)
+{
+    if (!t_cmd_list) {
+        gl2__cull_reset_view();
+    }
+
+    gl2__append_command(GL2__CMD_RESET_VIEW, NULL);
+}
+
+//------------------------------------------------------------------------------
+// Transformation
+
+static void gl2__reset_baked_matrix(gl2__cmd_list *list)
+{
+    list->baked_current_matrix = 0;
+    qu_mat4_identity(&list->baked_matrix[0]);
+}
+
+/**
+ * Get the record-time matrix of the current thread.
+ */
+static qu_mat4 *gl2__get_baked_matrix(void)
+{
+    gl2__cmd_list *list = gl2__get_record_list();
+    return &list->baked_matrix[list->baked_current_matrix];
+}
+
+static void gl2_push_matrix(void)
+{
+    if (g_state.bake_transforms) {
+        gl2__cmd_list *list = gl2__get_record_list();
+        gl2__push_matrix(list->baked_matrix, &list->baked_current_matrix);
+        return;
+    }
+
+    gl2__append_command(GL2__CMD_PUSH_MATRIX, NULL);
+}
+
+static void gl2_pop_matrix(void)
+{
+    if (g_state.bake_transforms) {
+        gl2__pop_matrix(&gl2__get_record_list()->baked_current_matrix);
+        return;
+    }
+
+    gl2__append_command(GL2__CMD_POP_MATRIX, NULL);
+}
+
+static void gl2_translate(float x, float y)
+{
+    if (g_state.bake_transforms) {
+        qu_mat4_translate(gl2__get_baked_matrix(), x, y, 0.f);
+        return;
+    }
+
+    if (!t_cmd_list) {
+        g_cull.transformed = true;
+    }
+
+    gl2__append_command(GL2__CMD_TRANSLATE, &(gl2__cmd_vec2) {
+        .x = x,
+        .y = y,
+    });
+}
+
+static void gl2_scale(float x, float y)
+{
+    if (g_state.bake_transforms) {
+        qu_mat4_scale(gl2__get_baked_matrix(), x, y, 1.f);
+        return;
+    }
+
+    if (!t_cmd_list) {
+        g_cull.transformed = true;
+    }
+
+    gl2__append_command(GL2__CMD_SCALE, &(gl2__cmd_vec2) {
+        .x = x,
+        .y = y,
+    });
+}
+
+static void gl2_rotate(float degrees)
+{
+    if (g_state.bake_transforms) {
+        qu_mat4_rotate(gl2__get_baked_matrix(), QU_DEG2RAD(degrees), 0.f, 0.f, 1.f);
+        return;
+    }
+
+    if (!t_cmd_list) {
+        g_cull.transformed = true;
+    }
+
+    gl2__append_command(GL2__CMD_ROTATE, &(gl2__cmd_rotate) {
+        .degrees = degrees,
+    });
+}
+
+static void gl2_set_layer(int layer)
+{
+    gl2__cmd_list *list = gl2__get_record_list();
+
+    list->layer = layer;
+
+    if (layer != 0) {
+        list->layered = true;
+    }
+}
+
+static void gl2_set_outline_width(float width)
+{
+    gl2__get_record_list()->outline_width = QU_MAX(0.f, width);
+}
+
+//------------------------------------------------------------------------------
+// Primitives
+
+static void gl2_clear(qu_color color)
+{
+    gl2__append_command(GL2__CMD_CLEAR, &(gl2__cmd_clear) {
+        .color = color,
+    });
+}
+
+static void gl2_draw_point(float x, float y, qu_color color)
+{
+    float vertices[] = {
+        x, y,
+    };
+
+    gl2__append_command(GL2__CMD_DRAW, &(gl2__cmd_draw) {
+        .color = 0xffffffff,
+        .program = GL2__PROG_SHAPE,
+        .format = GL2__VF_SOLID_COLORED,
+        .mode = GL_POINTS,
+        .first = gl2__append_solid_vertices(vertices, 1, color),
+        .count = 1,
+    });
+}
+
+static void gl2_draw_line(float ax, float ay, float bx, float by, qu_color color)
+{
+    float vertices[] = {
+        ax, ay,
+        bx, by,
+    };
+
+    gl2__append_command(GL2__CMD_DRAW, &(gl2__cmd_draw) {
+        .color = 0xffffffff,
+        .program = GL2__PROG_SHAPE,
+        .format = GL2__VF_SOLID_COLORED,
+        .mode = GL_LINES,
+        .first = gl2__append_solid_vertices(vertices, 2, color),
+        .count = 2,
+    });
+}
+
+/**
+ * Append outline of a polygon as one quad per edge, centered on
+ * the edge and mitered at the corners. `points` holds positions
+ * (x, y) of `count` corners in either winding order.
+ * Returns index of the first appended vertex, 4 * `count` vertices
+ * are appended.
+ */
+static int gl2__append_outline(float const *points, int count, qu_color color)
+{
+    gl2__cmd_list *list = gl2__get_record_list();
+    float half = list->outline_width / 2.f;
+
+    int first;
+    gl2__solid_vertex *dst =
+        gl2__alloc_vertices(GL2__VF_SOLID_COLORED, count * 4, &first);
+
+    if (!dst) {
+        return 0;
+    }
+
+    // Outward normals depend on the winding order.
+    float area = 0.f;
+
+    for (int i = 0; i < count; i++) {
+        int j = (i + 1) % count;
+        area += points[2 * i] * points[2 * j + 1] - points[2 * j] * points[2 * i + 1];
+    }
+
+    float sign = (area < 0.f) ? -1.f : 1.f;
+
+    GLubyte c[4];
+    gl2__pack_color(color, c);
+
+    for (int i = 0; i < count; i++) {
+        int prev = (i + count - 1) % count;
+        int next = (i + 1) % count;
+
+        float normals[2][2];
+        int edges[2][2] = { { prev, i }, { i, next } };
+
+        for (int k = 0; k < 2; k++) {
+            float dx = points[2 * edges[k][1] + 0] - points[2 * edges[k][0] + 0];
+            float dy = points[2 * edges[k][1] + 1] - points[2 * edges[k][0] + 1];
+            float length = sqrtf(dx * dx + dy * dy);
+
+            if (length > 0.f) {
+                normals[k][0] = sign * dy / length;
+                normals[k][1] = -sign * dx / length;
+            } else {
+                normals[k][0] = normals[k][1] = 0.f;
+            }
+        }
+
+        // Miter offset is (n0 + n1) / (1 + n0 . n1), limited
+        // to 4 half widths on sharp corners.
+        float dot = normals[0][0] * normals[1][0] + normals[0][1] * normals[1][1];
+        float scale = half / QU_MAX(1.f + dot, 0.125f);
+        float mx = (normals[0][0] + normals[1][0]) * scale;
+        float my = (normals[0][1] + normals[1][1]) * scale;
+
+        float x = points[2 * i + 0];
+        float y = points[2 * i + 1];
+
+        // Corner i ends quad of the previous edge and starts its own:
+        // quad k is (outer k, outer k+1, inner k+1, inner k).
+        gl2__solid_vertex outer = { .x = x + mx, .y = y + my };
+        gl2__solid_vertex inner = { .x = x - mx, .y = y - my };
+
+        memcpy(outer.color, c, sizeof(c));
+        memcpy(inner.color, c, sizeof(c));
+
+        dst[4 * i + 0] = outer;
+        dst[4 * i + 3] = inner;
+        dst[4 * prev + 1] = outer;
+        dst[4 * prev + 2] = inner;
+    }
+
+    if (g_state.bake_transforms) {
+        gl2__bake_positions(dst, count * 4, sizeof(gl2__solid_vertex));
+    }
+
+    return first;
+}
+
+/**
+ * Fills and outlines of triangles and rectangles are recorded as
+ * indexed quads in the same vertex format, so any sequence of them
+ * collapses into a single batch.
+ */
+static void gl2__append_shape(float const *vertices, int count,
+                              qu_color outline, qu_color fill)
+{
+    int fill_alpha = (fill >> 24) & 255;
+    int outline_alpha = (outline >> 24) & 255;
+
+    if (fill_alpha > 0) {
+        // Triangle is a quad with the last corner repeated.
+        float quad[8];
+
+        memcpy(quad, vertices, sizeof(float) * 2 * count);
+
+        for (int i = count; i < 4; i++) {
+            quad[2 * i + 0] = vertices[2 * count - 2];
+            quad[2 * i + 1] = vertices[2 * count - 1];
+        }
+
+        gl2__append_command(GL2__CMD_DRAW, &(gl2__cmd_draw) {
+            .color = 0xffffffff,
+            .program = GL2__PROG_SHAPE,
+            .format = GL2__VF_SOLID_COLORED,
+            .mode = GL_TRIANGLES,
+            .first = gl2__append_solid_vertices(quad, 4, fill),
+            .count = 4,
+            .indexed = true,
+        });
+    }
+
+    if (outline_alpha > 0 && gl2__get_record_list()->outline_width > 0.f) {
+        gl2__append_command(GL2__CMD_DRAW, &(gl2__cmd_draw) {
+            .color = 0xffffffff,
+            .program = GL2__PROG_SHAPE,
+            .format = GL2__VF_SOLID_COLORED,
+            .mode = GL_TRIANGLES,
+            .first = gl2__append_outline(vertices, count, outline),
+            .count = count * 4,
+            .indexed = true,
+        });
+    }
+}
+
+static void gl2_draw_triangle(float ax, float ay, float bx, float by,
+                              float cx, float cy, qu_color outline, qu_color fill)
+{
+    float vertices[] = {
+        ax, ay,
+        bx, by,
+        cx, cy,
+    };
+
+    gl2__append_shape(vertices, 3, outline, fill);
+}
+
+static void gl2_draw_rectangle(float x, float y, float w, float h,
+                               qu_color outline, qu_color fill)
+{
+    float e = gl2__get_record_list()->outline_width / 2.f;
+
+    if (!gl2__is_visible(QU_MIN(x, x + w) - e, QU_MIN(y, y + h) - e,
+                         fabsf(w) + 2.f * e, fabsf(h) + 2.f * e)) {
+        return;
+    }
+
+    float vertices[] = {
+        x,      y,
+        x + w,  y,
+        x + w,  y + h,
+        x,      y + h,
+    };
+
+    gl2__append_shape(vertices, 4, outline, fill);
+}
+
+/**
+ * Circles are drawn as a single quad each, the fragment shader computes
+ * coverage from the distance to the center. Edges are antialiased over
+ * one unit, the outline is centered on the circumference. Consecutive
+ * circles end up in one batch as they share state.
+ */
+static void gl2_draw_circle(float x, float y, float radius, qu_color outline, qu_color fill)
+{
+    int fill_alpha = (fill >> 24) & 255;
+    int outline_alpha = (outline >> 24) & 255;
+    float outline_width = gl2__get_record_list()->outline_width;
+    float extent = radius + outline_width / 2.f + 1.f;
+
+    if (!gl2__is_visible(x - extent, y - extent, 2.f * extent, 2.f * extent)) {
+        return;
+    }
+
+    if (outline_alpha == 0 || outline_width == 0.f) {
+        if (fill_alpha == 0) {
+            return;
+        }
+
+        outline = fill;
+        outline_width = 0.f;
+    } else if (fill_alpha == 0) {
+        // Fade to the outline color rather than to black.
+        fill = outline & 0x00ffffff;
+    }
+
+    int first;
+    gl2__circle_vertex *dst =
+        gl2__alloc_vertices(GL2__VF_CIRCLE, 4, &first);
+
+    if (!dst) {
+        return;
+    }
+
+    GLubyte f[4], o[4];
+    gl2__pack_color(fill, f);
+    gl2__pack_color(outline, o);
+
+    // Leave room for the outline and the antialiased edge.
+    float e = radius + outline_width / 2.f + 1.f;
+
+    float const corners[] = {
+        -e, -e,
+         e, -e,
+         e,  e,
+        -e,  e,
+    };
+
+    for (int i = 0; i < 4; i++) {
+        dst[i].x = x + corners[2 * i + 0];
+        dst[i].y = y + corners[2 * i + 1];
+        memcpy(dst[i].color, f, sizeof(f));
+        memcpy(dst[i].outline, o, sizeof(o));
+        dst[i].cx = corners[2 * i + 0];
+        dst[i].cy = corners[2 * i + 1];
+        dst[i].radius = radius;
+        dst[i].outline_width = outline_width;
+    }
+
+    if (g_state.bake_transforms) {
+        gl2__bake_positions(dst, 4, sizeof(gl2__circle_vertex));
+    }
+
+    gl2__append_command(GL2__CMD_DRAW, &(gl2__cmd_draw) {
+        .color = 0xffffffff,
+        .program = GL2__PROG_CIRCLE,
+        .format = GL2__VF_CIRCLE,
+        .mode = GL_TRIANGLES,
+        .first = first,
+        .count = 4,
+        .indexed = true,
+    });
+}
+
+//------------------------------------------------------------------------------
+// Texture uploads
+
+/**
+ * Copy `size` bytes into the next pixel buffer of the ring, which is
+ * left bound to GL_PIXEL_UNPACK_BUFFER. Returns false and leaves
+ * nothing bound if the buffer couldn't be mapped.
+ */
+static bool gl2__fill_pixel_buffer(void const *data, size_t size)
+{
+    gl2__upload_buf *buffer = &g_upload_buf;
+
+    if (size == 0) {
+        return false;
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer->pbo[buffer->pbo_index]);
+    buffer->pbo_index = (buffer->pbo_index + 1) % GL2__PBO_RING_SIZE;
+
+    // Orphan the previous storage, so that the driver doesn't
+    // wait until pending uploads from it are finished.
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+
+    void *dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+                                 GL_MAP_WRITE_BIT |
+                                 GL_MAP_INVALIDATE_BUFFER_BIT);
+
+    if (dst) {
+        memcpy(dst, data, size);
+
+        if (glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER)) {
+            return true;
+        }
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    return false;
+}
+
+/**
+ * Reserve space for pixels of the texture rectangle in the staging
+ * buffer. Caller fills it, it's uploaded on the next flush.
+ */
+static unsigned char *gl2__stage_upload(int32_t texture_id, int x, int y,
+                                        int w, int h, GLenum format,
+                                        int channels)
+{
+    gl2__upload_buf *buffer = &g_upload_buf;
+    size_t bytes = (size_t) w * h * channels;
+
+    if (buffer->count == buffer->max_count) {
+        int max_count = buffer->max_count ? buffer->max_count * 2 : 64;
+        gl2__upload *uploads = realloc(buffer->uploads, sizeof(gl2__upload) * max_count);
+
+        if (!uploads) {
+            return NULL;
+        }
+
+        buffer->uploads = uploads;
+        buffer->max_count = max_count;
+    }
+
+    if (buffer->size + bytes > buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity : 65536;
+
+        while (capacity < buffer->size + bytes) {
+            capacity *= 2;
+        }
+
+        unsigned char *data = realloc(buffer->data, capacity);
+
+        if (!data) {
+            return NULL;
+        }
+
+        buffer->data = data;
+        buffer->capacity = capacity;
+    }
+
+    buffer->uploads[buffer->count++] = (gl2__upload) {
+        .texture_id = texture_id,
+        .x = x,
+        .y = y,
+        .w = w,
+        .h = h,
+        .format = format,
+        .offset = buffer->size,
+    };
+
+    unsigned char *pixels = buffer->data + buffer->size;
+
+    // Keep every rectangle 4-byte aligned.
+    buffer->size += (bytes + 3) & ~((size_t) 3);
+
+    return pixels;
+}
+
+/**
+ * Upload all staged texture updates. With pixel buffers, the whole
+ * staging buffer is copied into the next mapped PBO of the ring at
+ * once and textures are updated from offsets in it, otherwise from
+ * client memory.
+ */
+static void gl2__flush_uploads(void)
+{
+    gl2__upload_buf *buffer = &g_upload_buf;
+
+    if (buffer->count == 0) {
+        return;
+    }
+
+    unsigned char const *base = buffer->data;
+
+    bool mapped = g_caps.pixel_buffer
+        && gl2__fill_pixel_buffer(buffer->data, buffer->size);
+
+    if (mapped) {
+        base = NULL;
+    }
+
+    for (int i = 0; i < buffer->count; i++) {
+        gl2__upload const *upload = &buffer->uploads[i];
+        gl2__texture *texture = libqu_array_get(g_textures, upload->texture_id);
+
+        // Deleted after it was updated
+        if (!texture) {
+            continue;
+        }
+
+        if (g_state.texture_id != upload->texture_id) {
+            glBindTexture(GL_TEXTURE_2D, texture->handle);
+            g_state.texture_id = upload->texture_id;
+        }
+
+        glTexSubImage2D(GL_TEXTURE_2D, 0, upload->x, upload->y,
+                        upload->w, upload->h, upload->format,
+                        GL_UNSIGNED_BYTE, base + upload->offset);
+    }
+
+    if (mapped) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    // Mipmaps of updated textures are regenerated once per run of
+    // updates to the same texture.
+    if (g_caps.generate_mipmap) {
+        for (int i = 0; i < buffer->count; i++) {
+            int32_t id = buffer->uploads[i].texture_id;
+
+            if (i + 1 < buffer->count && buffer->uploads[i + 1].texture_id == id) {
+                continue;
+            }
+
+            gl2__texture *texture = libqu_array_get(g_textures, id);
+
+            if (!texture || !gl2__is_mipmap_filter(texture->min_filter)) {
+                continue;
+            }
+
+            glBindTexture(GL_TEXTURE_2D, texture->handle);
+            glGenerateMipmap(GL_TEXTURE_2D);
+            g_state.texture_id = id;
+        }
+    }
+
+    buffer->size = 0;
+    buffer->count = 0;
+}
+
+//------------------------------------------------------------------------------
+// Texture atlas
+
+/**
+ * Find the lowest position where a `w` by `h` rectangle fits if its left
+ * edge is at the start of skyline node `index`. Returns -1 if it doesn't.
+ */
+static int gl2__skyline_fit(gl2__atlas_page *page, int index, int w, int h)
+{
+    int x = page->skyline[index].x;
+
+    if (x + w > g_atlas.page_size) {
+        return -1;
+    }
+
+    int y = 0;
+
+    for (int i = index, remaining = w; remaining > 0; i++) {
+        y = QU_MAX(y, page->skyline[i].y);
+
+        if (y + h > g_atlas.page_size) {
+            return -1;
+        }
+
+        remaining -= page->skyline[i].width;
+    }
+
+    return y;
+}
+
+/**
+ * Reserve a `w` by `h` rectangle in the page with bottom-left skyline
+ * packing. Returns false if the page is full.
+ */
+static bool gl2__skyline_insert(gl2__atlas_page *page, int w, int h, int *x, int *y)
+{
+    int best_index = -1;
+    int best_y = g_atlas.page_size;
+    int best_width = g_atlas.page_size + 1;
+
+    for (int i = 0; i < page->skyline_count; i++) {
+        int node_y = gl2__skyline_fit(page, i, w, h);
+
+        if (node_y < 0) {
+            continue;
+        }
+
+        if (node_y < best_y || (node_y == best_y && page->skyline[i].width < best_width)) {
+            best_index = i;
+            best_y = node_y;
+            best_width = page->skyline[i].width;
+        }
+    }
+
+    if (best_index < 0) {
+        return false;
+    }
+
+    gl2__skyline_node *nodes = page->skyline;
+
+    *x = nodes[best_index].x;
+    *y = best_y;
+
+    // Raise the skyline over the new rectangle...
+    memmove(&nodes[best_index + 1], &nodes[best_index],
+            sizeof(gl2__skyline_node) * (page->skyline_count - best_index));
+
+    nodes[best_index] = (gl2__skyline_node) { *x, best_y + h, w };
+    page->skyline_count++;
+
+    // ...cut off nodes covered by it...
+    for (int i = best_index + 1; i < page->skyline_count; i++) {
+        int shrink = (nodes[i - 1].x + nodes[i - 1].width) - nodes[i].x;
+
+        if (shrink <= 0) {
+            break;
+        }
+
+        nodes[i].x += shrink;
+        nodes[i].width -= shrink;
+
+        if (nodes[i].width > 0) {
+            break;
+        }
+
+        memmove(&nodes[i], &nodes[i + 1],
+                sizeof(gl2__skyline_node) * (page->skyline_count - i - 1));
+        page->skyline_count--;
+        i--;
+    }
+
+    // ...and merge neighbours of the same height.
+    for (int i = 0; i < page->skyline_count - 1; i++) {
+        if (nodes[i].y == nodes[i + 1].y) {
+            nodes[i].width += nodes[i + 1].width;
+
+            memmove(&nodes[i + 1], &nodes[i + 2],
+                    sizeof(gl2__skyline_node) * (page->skyline_count - i - 2));
+            page->skyline_count--;
+            i--;
+        }
+    }
+
+    return true;
+}
+
+static gl2__atlas_page *gl2__add_atlas_page(bool smooth, GLenum min_filter)
+{
+    int size = g_atlas.page_size;
+
+    gl2__atlas_page *pages = realloc(g_atlas.pages,
+                                     sizeof(gl2__atlas_page) * (g_atlas.page_count + 1));
+
+    if (!pages) {
+        return NULL;
+    }
+
+    g_atlas.pages = pages;
+
+    gl2__atlas_page page = {
+        .smooth = smooth,
+        .min_filter = min_filter,
+        .pixels = calloc(size * size, 4),
+        .skyline = malloc(sizeof(gl2__skyline_node) * (size + 1)),
+    };
+
+    if (!page.pixels || !page.skyline) {
+        free(page.pixels);
+        free(page.skyline);
+        return NULL;
+    }
+
+    gl2__texture texture = {
+        .width = size,
+        .height = size,
+        .channels = 4,
+        .format = GL_RGBA,
+        .smooth = smooth,
+        .min_filter = min_filter,
+        .s1 = 1.f,
+        .t1 = 1.f,
+    };
+
+    glGenTextures(1, &texture.handle);
+
+    glBindTexture(GL_TEXTURE_2D, texture.handle);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, size, size,
+                 0, GL_RGBA, GL_UNSIGNED_BYTE, page.pixels);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, smooth ? GL_LINEAR : GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, min_filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    page.texture_id = libqu_array_add(g_textures, &texture);
+
+    if (!page.texture_id) {
+        free(page.pixels);
+        free(page.skyline);
+        return NULL;
+    }
+
+    g_state.texture_id = page.texture_id;
+
+    page.skyline[0] = (gl2__skyline_node) { 0, 0, size };
+    page.skyline_count = 1;
+
+    libqu_info("Created texture atlas page %d (%dx%d).\n", g_atlas.page_count, size, size);
+
+    g_atlas.pages[g_atlas.page_count] = page;
+    return &g_atlas.pages[g_atlas.page_count++];
+}
+
+/**
+ * Find space for `texture` in a page with matching filtering and
+ * fill its atlas fields. Returns false if it doesn't fit anywhere.
+ */
+static bool gl2__atlas_pack(gl2__texture *texture)
+{
+    int w = texture->width + 2 * GL2__ATLAS_PADDING;
+    int h = texture->height + 2 * GL2__ATLAS_PADDING;
+
+    if (w > g_atlas.page_size || h > g_atlas.page_size) {
+        return false;
+    }
+
+    int x, y;
+    int index = -1;
+
+    for (int i = 0; i < g_atlas.page_count; i++) {
+        gl2__atlas_page *page = &g_atlas.pages[i];
+
+        if (page->smooth != texture->smooth || page->min_filter != texture->min_filter) {
+            continue;
+        }
+
+        if (gl2__skyline_insert(page, w, h, &x, &y)) {
+            index = i;
+            break;
+        }
+    }
+
+    if (index < 0) {
+        gl2__atlas_page *page = gl2__add_atlas_page(texture->smooth, texture->min_filter);
+
+        if (!page || !gl2__skyline_insert(page, w, h, &x, &y)) {
+            return false;
+        }
+
+        index = g_atlas.page_count - 1;
+    }
+
+    gl2__atlas_page *page = &g_atlas.pages[index];
+    float size = g_atlas.page_size;
+
+    page->refs++;
+
+    texture->atlas_id = page->texture_id;
+    texture->atlas_page = index;
+    texture->atlas_x = x + GL2__ATLAS_PADDING;
+    texture->atlas_y = y + GL2__ATLAS_PADDING;
+    texture->s0 = texture->atlas_x / size;
+    texture->t0 = texture->atlas_y / size;
+    texture->s1 = (texture->atlas_x + texture->width) / size;
+    texture->t1 = (texture->atlas_y + texture->height) / size;
+
+    return true;
+}
+
+/**
+ * Write a region of a packed texture and upload it along with padding.
+ * `pixels` have `channels` components, `stride` is the size of a row
+ * in bytes.
+ */
+static void gl2__atlas_write(gl2__texture *texture, int x, int y, int w, int h,
+                             uint8_t const *pixels, int channels, int stride)
+{
+    gl2__atlas_page *page = &g_atlas.pages[texture->atlas_page];
+    int page_stride = g_atlas.page_size * 4;
+
+    // Convert to RGBA the same way as GL treats 1- and 2-channel formats.
+    for (int j = 0; j < h; j++) {
+        uint8_t const *src = pixels + j * stride;
+        unsigned char *dst = page->pixels + (texture->atlas_y + y + j) * page_stride
+                           + (texture->atlas_x + x) * 4;
+
+        for (int i = 0; i < w; i++, src += channels, dst += 4) {
+            switch (channels) {
+            case 1:
+                dst[0] = dst[1] = dst[2] = src[0];
+                dst[3] = 255;
+                break;
+            case 2:
+                dst[0] = dst[1] = dst[2] = src[0];
+                dst[3] = src[1];
+                break;
+            case 3:
+                memcpy(dst, src, 3);
+                dst[3] = 255;
+                break;
+            default:
+                memcpy(dst, src, 4);
+                break;
+            }
+        }
+    }
+
+    // Repeat edge pixels into padding.
+    int ax = texture->atlas_x;
+    int ay = texture->atlas_y;
+    int bx = ax + texture->width - 1;
+    int by = ay + texture->height - 1;
+
+    for (int j = ay; j <= by; j++) {
+        unsigned char *row = page->pixels + j * page_stride;
+
+        for (int p = 1; p <= GL2__ATLAS_PADDING; p++) {
+            memcpy(row + (ax - p) * 4, row + ax * 4, 4);
+            memcpy(row + (bx + p) * 4, row + bx * 4, 4);
+        }
+    }
+
+    int row_size = (texture->width + 2 * GL2__ATLAS_PADDING) * 4;
+
+    for (int p = 1; p <= GL2__ATLAS_PADDING; p++) {
+        memcpy(page->pixels + (ay - p) * page_stride + (ax - GL2__ATLAS_PADDING) * 4,
+               page->pixels + ay * page_stride + (ax - GL2__ATLAS_PADDING) * 4,
+               row_size);
+        memcpy(page->pixels + (by + p) * page_stride + (ax - GL2__ATLAS_PADDING) * 4,
+               page->pixels + by * page_stride + (ax - GL2__ATLAS_PADDING) * 4,
+               row_size);
+    }
+
+    // GLES 2.0 can't upload a part of a row, so rows of the whole
+    // padded rectangle are staged together.
+    int rows = texture->height + 2 * GL2__ATLAS_PADDING;
+    unsigned char *region = gl2__stage_upload(page->texture_id,
+                                              ax - GL2__ATLAS_PADDING,
+                                              ay - GL2__ATLAS_PADDING,
+                                              texture->width + 2 * GL2__ATLAS_PADDING,
+                                              rows, GL_RGBA, 4);
+
+    if (!region) {
+        return;
+    }
+
+    for (int j = 0; j < rows; j++) {
+        memcpy(region + j * row_size,
+               page->pixels + (ay - GL2__ATLAS_PADDING + j) * page_stride
+                            + (ax - GL2__ATLAS_PADDING) * 4,
+               row_size);
+    }
+}
+
+/**
+ * Move a packed texture to a page matching its filtering.
+ */
+static void gl2__atlas_repack(int32_t texture_id)
+{
+    gl2__texture *texture = libqu_array_get(g_textures, texture_id);
+    gl2__atlas_page *page = &g_atlas.pages[texture->atlas_page];
+    int page_stride = g_atlas.page_size * 4;
+
+    unsigned char *pixels = malloc(texture->width * texture->height * 4);
+
+    if (!pixels) {
+        return;
+    }
+
+    for (unsigned int j = 0; j < texture->height; j++) {
+        memcpy(pixels + j * texture->width * 4,
+               page->pixels + (texture->atlas_y + j) * page_stride + texture->atlas_x * 4,
+               texture->width * 4);
+    }
+
+    gl2__texture moved = *texture;
+
+    // New page may be created, so `texture` is looked up again.
+    if (gl2__atlas_pack(&moved)) {
+        gl2__atlas_write(&moved, 0, 0, moved.width, moved.height,
+                         pixels, 4, moved.width * 4);
+
+        // Release the place in the old page.
+        texture = libqu_array_get(g_textures, texture_id);
+        gl2__texture_dtor(texture);
+        *texture = moved;
+    }
+
+    free(pixels);
+}
+
+//------------------------------------------------------------------------------
+// Textures
+
+static int32_t gl2_create_texture(int width, int height, int channels)
+{
+    if ((width < 0) || (height < 0)) {
+        return 0;
+    }
+
+    if ((channels < 1) || (channels > 4)) {
+        return 0;
+    }
+
+    GLenum format = gl2__get_texture_format(channels);
+
+    if (format == GL_INVALID_ENUM) {
+        return 0;
+    }
+
+    gl2__texture texture = {0};
+
+    gl2__acquire_context();
+
+    glGenTextures(1, &texture.handle);
+
+    glBindTexture(GL_TEXTURE_2D, texture.handle);
+    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height,
+                 0, format, GL_UNSIGNED_BYTE, NULL);
+
+    texture.width = width;
+    texture.height = height;
+    texture.channels = channels;
+    texture.format = format;
+    texture.min_filter = GL_LINEAR;
+    texture.s1 = 1.f;
+    texture.t1 = 1.f;
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+    g_state.texture_id = libqu_array_add(g_textures, &texture);
+
+    gl2__release_context();
+
+    if (g_state.texture_id > 0) {
+        libqu_info("Created texture 0x%08x.\n", g_state.texture_id);
+    }
+
+    return g_state.texture_id;
+}
+
+static void gl2_update_texture(int32_t texture_id, int x, int y, int w, int h,
+                               uint8_t const *pixels)
+{
+    gl2__texture *texture = libqu_array_get(g_textures, texture_id);
+
+    if (!texture) {
+        return;
+    }
+
+    // Contents of textures being loaded are yet to be replaced.
+    if (texture->job || texture->failed) {
+        return;
+    }
+
+    if (texture->compressed_levels) {
+        libqu_warning("Compressed texture 0x%08x can't be updated.\n", texture_id);
+        return;
+    }
+
+    if (x == 0 && y == 0 && w == -1 && h == -1) {
+        w = texture->width;
+        h = texture->height;
+    }
+
+    // Atlas pages and staging buffers are written directly,
+    // so the rectangle has to be checked here.
+    if (x < 0 || y < 0 || w <= 0 || h <= 0 ||
+        w > (int) texture->width - x || h > (int) texture->height - y) {
+        libqu_warning("Rectangle (%d, %d, %d, %d) is out of bounds of texture 0x%08x.\n",
+                      x, y, w, h, texture_id);
+        return;
+    }
+
+    // Pixels are only staged here, GL context is not needed until
+    // they are flushed at present.
+    if (texture->atlas_id) {
+        gl2__atlas_write(texture, x, y, w, h, pixels, texture->channels,
+                         w * texture->channels);
+    } else {
+        unsigned char *staged = gl2__stage_upload(texture_id, x, y, w, h,
+                                                  texture->format,
+                                                  texture->channels);
+
+        if (staged) {
+            memcpy(staged, pixels, (size_t) w * h * texture->channels);
+        }
+    }
+}
+
+static bool gl2__can_mipmap(gl2__texture const *texture)
+{
+    if (g_caps.npot_mipmaps) {
+        return true;
+    }
+
+    return !(texture->width & (texture->width - 1))
+        && !(texture->height & (texture->height - 1));
+}
+
+/**
+ * Build mipmap levels on the CPU with a 2x2 box filter, for drivers
+ * lacking glGenerateMipmap(). Texture should be bound.
+ */
+static void gl2__build_mipmaps(gl2__texture const *texture, uint8_t const *pixels)
+{
+    int channels = texture->channels;
+    int w = texture->width;
+    int h = texture->height;
+
+    uint8_t *level = NULL;
+    uint8_t const *src = pixels;
+
+    for (int n = 1; w > 1 || h > 1; n++) {
+        int next_w = QU_MAX(1, w / 2);
+        int next_h = QU_MAX(1, h / 2);
+        uint8_t *dst = malloc(next_w * next_h * channels);
+
+        if (!dst) {
+            break;
+        }
+
+        for (int y = 0; y < next_h; y++) {
+            int y0 = QU_MIN(y * 2, h - 1);
+            int y1 = QU_MIN(y * 2 + 1, h - 1);
+
+            for (int x = 0; x < next_w; x++) {
+                int x0 = QU_MIN(x * 2, w - 1);
+                int x1 = QU_MIN(x * 2 + 1, w - 1);
+
+                for (int c = 0; c < channels; c++) {
+                    int sum = src[(y0 * w + x0) * channels + c]
+                            + src[(y0 * w + x1) * channels + c]
+                            + src[(y1 * w + x0) * channels + c]
+                            + src[(y1 * w + x1) * channels + c];
+
+                    dst[(y * next_w + x) * channels + c] = (sum + 2) / 4;
+                }
+            }
+        }
+
+        glTexImage2D(GL_TEXTURE_2D, n, texture->format, next_w, next_h,
+                     0, texture->format, GL_UNSIGNED_BYTE, dst);
+
+        free(level);
+        level = dst;
+        src = dst;
+        w = next_w;
+        h = next_h;
+    }
+
+    free(level);
+}
+
+/**
+ * Create GL texture with the given contents, filtering and mipmaps.
+ */
+static void gl2__create_gl_texture(gl2__texture *texture, uint8_t const *pixels)
+{
+    GLsizei w = texture->width;
+    GLsizei h = texture->height;
+    GLenum format = texture->format;
+
+    glGenTextures(1, &texture->handle);
+    glBindTexture(GL_TEXTURE_2D, texture->handle);
+
+    size_t size = (size_t) w * h * texture->channels;
+
+    if (g_caps.pixel_buffer && gl2__fill_pixel_buffer(pixels, size)) {
+        glTexImage2D(GL_TEXTURE_2D, 0, format, w, h, 0, format, GL_UNSIGNED_BYTE, NULL);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    } else {
+        glTexImage2D(GL_TEXTURE_2D, 0, format, w, h, 0, format, GL_UNSIGNED_BYTE, pixels);
+    }
+
+    if (gl2__is_mipmap_filter(texture->min_filter)) {
+        if (!gl2__can_mipmap(texture)) {
+            libqu_warning("Can't generate mipmaps for %dx%d texture.\n", w, h);
+            texture->min_filter = GL_LINEAR;
+        } else if (g_caps.generate_mipmap) {
+            glGenerateMipmap(GL_TEXTURE_2D);
+        } else {
+            gl2__build_mipmaps(texture, pixels);
+        }
+    }
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER,
+                    texture->smooth ? GL_LINEAR : GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, texture->min_filter);
+
+#ifdef __EMSCRIPTEN__
+    // I don't know what's going on, but without these parameters
+    // textures are rendered as black in WebGL
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+#endif
+
+    // Binding is not tracked for textures without id yet.
+    g_state.texture_id = -1;
+}
+
+/**
+ * Move a packed texture out of its atlas page into a texture of its own.
+ */
+static void gl2__atlas_unpack(int32_t texture_id)
+{
+    gl2__texture *texture = libqu_array_get(g_textures, texture_id);
+    gl2__atlas_page *page = &g_atlas.pages[texture->atlas_page];
+    int page_stride = g_atlas.page_size * 4;
+    int channels = texture->channels;
+
+    uint8_t *pixels = malloc(texture->width * texture->height * channels);
+
+    if (!pixels) {
+        return;
+    }
+
+    // Reverse of the conversion done in gl2__atlas_write().
+    for (unsigned int j = 0; j < texture->height; j++) {
+        unsigned char const *src = page->pixels + (texture->atlas_y + j) * page_stride
+                                 + texture->atlas_x * 4;
+        uint8_t *dst = pixels + j * texture->width * channels;
+
+        for (unsigned int i = 0; i < texture->width; i++, src += 4, dst += channels) {
+            switch (channels) {
+            case 1:
+                dst[0] = src[0];
+                break;
+            case 2:
+                dst[0] = src[0];
+                dst[1] = src[3];
+                break;
+            default:
+                memcpy(dst, src, channels);
+                break;
+            }
+        }
+    }
+
+    gl2__texture unpacked = *texture;
+
+    unpacked.atlas_id = 0;
+    unpacked.s0 = 0.f;
+    unpacked.t0 = 0.f;
+    unpacked.s1 = 1.f;
+    unpacked.t1 = 1.f;
+
+    gl2__create_gl_texture(&unpacked, pixels);
+
+    // Release the place in the page.
+    gl2__texture_dtor(texture);
+    *texture = unpacked;
+
+    free(pixels);
+}
+
+/**
+ * Create GL texture from compressed image with all its mip levels.
+ */
+static bool gl2__upload_compressed_image(gl2__texture *texture, libqu_image *image)
+{
+    GLenum format = gl2__get_compressed_format(image->compression);
+
+    if (format == GL_INVALID_ENUM) {
+        libqu_error("Compressed texture format %d is not supported by the GPU.\n",
+                    image->compression);
+        return false;
+    }
+
+    texture->width = image->width;
+    texture->height = image->height;
+    texture->channels = 0;
+    texture->format = format;
+    texture->compressed_levels = image->level_count;
+    texture->s0 = 0.f;
+    texture->t0 = 0.f;
+    texture->s1 = 1.f;
+    texture->t1 = 1.f;
+
+    glGenTextures(1, &texture->handle);
+    glBindTexture(GL_TEXTURE_2D, texture->handle);
+
+    unsigned char const *data = image->pixels;
+
+    for (int i = 0; i < image->level_count; i++) {
+        glCompressedTexImage2D(GL_TEXTURE_2D, i, format,
+                               QU_MAX(1, image->width >> i),
+                               QU_MAX(1, image->height >> i),
+                               0, image->level_sizes[i], data);
+
+        data += image->level_sizes[i];
+    }
+
+    if (gl2__is_mipmap_filter(texture->min_filter)
+        && texture->compressed_levels != gl2__get_full_level_count(texture->width, texture->height)) {
+        libqu_warning("Compressed texture has no complete mipmap chain.\n");
+        texture->min_filter = GL_LINEAR;
+    }
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER,
+                    texture->smooth ? GL_LINEAR : GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, texture->min_filter);
+
+    // Binding is not tracked for textures without id yet.
+    g_state.texture_id = -1;
+
+    return true;
+}
+
+/**
+ * Upload decoded image as contents of the texture: either pack it into
+ * an atlas page or create a GL texture for it. Texture is not added to
+ * the array, since packing may add pages to it.
+ */
+static bool gl2__upload_image(gl2__texture *texture, libqu_image *image)
+{
+    if (image->compression != LIBQU_COMPRESSION_NONE) {
+        return gl2__upload_compressed_image(texture, image);
+    }
+
+    GLenum format = gl2__get_texture_format(image->channels);
+
+    if (format == GL_INVALID_ENUM) {
+        return false;
+    }
+
+    texture->width = image->width;
+    texture->height = image->height;
+    texture->channels = image->channels;
+    texture->format = format;
+    texture->s0 = 0.f;
+    texture->t0 = 0.f;
+    texture->s1 = 1.f;
+    texture->t1 = 1.f;
+
+    // Small textures share atlas pages, so they can be drawn in one batch.
+    // Mipmaps of packed textures would bleed into each other.
+    if (texture->width <= GL2__ATLAS_MAX_TEXTURE_SIZE
+        && texture->height <= GL2__ATLAS_MAX_TEXTURE_SIZE
+        && !gl2__is_mipmap_filter(texture->min_filter)
+        && gl2__atlas_pack(texture)) {
+        gl2__atlas_write(texture, 0, 0, texture->width, texture->height,
+                         image->pixels, image->channels,
+                         image->width * image->channels);
+        return true;
+    }
+
+    gl2__create_gl_texture(texture, image->pixels);
+
+    return true;
+}
+
+static int32_t gl2_load_texture(libqu_file *file)
+{
+    libqu_image *image = libqu_load_image(file);
+    libqu_fclose(file);
+
+    if (!image) {
+        return 0;
+    }
+
+    gl2__texture texture = {
+        .min_filter = GL_LINEAR,
+    };
+
+    gl2__acquire_context();
+
+    int32_t id = 0;
+
+    if (gl2__upload_image(&texture, image)) {
+        id = libqu_array_add(g_textures, &texture);
+    }
+
+    gl2__release_context();
+
+    if (id > 0) {
+        if (texture.atlas_id) {
+            libqu_info("Loaded texture 0x%08x into atlas page %d.\n",
+                       id, texture.atlas_page);
+        } else {
+            libqu_info("Loaded texture 0x%08x.\n", id);
+        }
+    }
+
+    libqu_delete_image(image);
+
+    return id;
+}
+
+static int32_t gl2_load_texture_async(libqu_file *file)
+{
+    libqu_image_job *job = libqu_load_image_async(file);
+
+    if (!job) {
+        // No worker threads, fall back to loading right away.
+        return gl2_load_texture(file);
+    }
+
+    gl2__pending_loads *pending = &g_pending_loads;
+
+    if (pending->count == pending->capacity) {
+        int capacity = pending->capacity ? pending->capacity * 2 : 16;
+        int32_t *ids = realloc(pending->ids, sizeof(int32_t) * capacity);
+
+        if (!ids) {
+            libqu_cancel_image_job(job);
+            return 0;
+        }
+
+        pending->ids = ids;
+        pending->capacity = capacity;
+    }
+
+    // Until the image is decoded, texture has size of the placeholder.
+    gl2__texture texture = {
+        .width = 1,
+        .height = 1,
+        .channels = 4,
+        .format = GL_RGBA,
+        .min_filter = GL_LINEAR,
+        .s1 = 1.f,
+        .t1 = 1.f,
+        .job = job,
+    };
+
+    // Render thread may be reading the array.
+    gl2__acquire_context();
+    int32_t id = libqu_array_add(g_textures, &texture);
+    gl2__release_context();
+
+    // On failure, the job is cancelled by the destructor.
+    if (id == 0) {
+        return 0;
+    }
+
+    pending->ids[pending->count++] = id;
+
+    return id;
+}
+
+/**
+ * Upload images decoded since the last frame. Called once per frame
+ * from the main thread.
+ */
+static void gl2__finish_texture_loads(void)
+{
+    gl2__pending_loads *pending = &g_pending_loads;
+    int remaining = 0;
+
+    for (int i = 0; i < pending->count; i++) {
+        int32_t id = pending->ids[i];
+        gl2__texture *texture = libqu_array_get(g_textures, id);
+
+        // Deleted before it was loaded
+        if (!texture) {
+            continue;
+        }
+
+        libqu_image *image;
+
+        if (!libqu_poll_image_job(texture->job, &image)) {
+            pending->ids[remaining++] = id;
+            continue;
+        }
+
+        gl2__lock_resources();
+        texture->job = NULL;
+        texture->failed = !image;
+        gl2__unlock_resources();
+
+        if (!image) {
+            libqu_error("Failed to load texture 0x%08x.\n", id);
+            continue;
+        }
+
+        gl2__texture copy = *texture;
+
+        gl2__acquire_context();
+        bool uploaded = gl2__upload_image(&copy, image);
+        gl2__release_context();
+
+        libqu_delete_image(image);
+
+        gl2__lock_resources();
+
+        // Packing may have added a page and moved the array.
+        texture = libqu_array_get(g_textures, id);
+
+        // Upload fails before anything is allocated for the copy,
+        // so it's dropped and the texture keeps the placeholder.
+        if (uploaded) {
+            *texture = copy;
+        } else {
+            texture->failed = true;
+        }
+
+        gl2__unlock_resources();
+
+        if (!uploaded) {
+            libqu_error("Failed to load texture 0x%08x.\n", id);
+            continue;
+        }
+
+        if (texture->atlas_id) {
+            libqu_info("Loaded texture 0x%08x into atlas page %d.\n",
+                       id, texture->atlas_page);
+        } else {
+            libqu_info("Loaded texture 0x%08x.\n", id);
+        }
+    }
+
+    pending->count = remaining;
+}
+
+static bool gl2_is_texture_ready(int32_t texture_id)
+{
+    gl2__texture *texture = libqu_array_get(g_textures, texture_id);
+
+    return texture && !texture->job && !texture->failed;
+}
+
+static void gl2_delete_texture(int32_t texture_id)
+{
+    gl2__texture *texture = libqu_array_get(g_textures, texture_id);
+
+    if (!texture) {
+        return;
+    }
+
+    gl2__acquire_context();
+    libqu_array_remove(g_textures, texture_id);
+    gl2__release_context();
+}
+
+/**
+ * Apply filtering fields of the texture, moving it between atlas pages
+ * or out of the atlas if needed.
+ */
+static void gl2__update_texture_filter(int32_t texture_id)
+{
+    gl2__texture *texture = libqu_array_get(g_textures, texture_id);
+
+    // Applied once loaded.
+    if (texture->job) {
+        return;
+    }
+
+    gl2__acquire_context();
+
+    if (texture->atlas_id) {
+        gl2__atlas_page *page = &g_atlas.pages[texture->atlas_page];
+
+        // Filtering is shared by the whole page.
+        if (gl2__is_mipmap_filter(texture->min_filter)) {
+            gl2__atlas_unpack(texture_id);
+        } else if (page->smooth != texture->smooth
+                   || page->min_filter != texture->min_filter) {
+            gl2__atlas_repack(texture_id);
+        }
+    } else if (texture->handle) {
+        glBindTexture(GL_TEXTURE_2D, texture->handle);
+
+        if (gl2__is_mipmap_filter(texture->min_filter)) {
+            if (texture->compressed_levels) {
+                int full = gl2__get_full_level_count(texture->width, texture->height);
+
+                if (texture->compressed_levels != full) {
+                    libqu_warning("Texture 0x%08x has no complete mipmap chain.\n", texture_id);
+                    texture->min_filter = GL_LINEAR;
+                }
+            } else if (!g_caps.generate_mipmap || !gl2__can_mipmap(texture)) {
+                libqu_warning("Can't generate mipmaps for texture 0x%08x.\n", texture_id);
+                texture->min_filter = GL_LINEAR;
+            } else {
+                glGenerateMipmap(GL_TEXTURE_2D);
+            }
+        }
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER,
+                        texture->smooth ? GL_LINEAR : GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, texture->min_filter);
+
+        g_state.texture_id = texture_id;
+    }
+
+    gl2__release_context();
+}
+
+static void gl2_set_texture_smooth(int32_t texture_id, bool smooth)
+{
+    gl2__texture *texture = libqu_array_get(g_textures, texture_id);
+
+    if (!texture) {
+        return;
+    }
+
+    gl2__lock_resources();
+    texture->smooth = smooth;
+    gl2__unlock_resources();
+
+    gl2__update_texture_filter(texture_id);
+}
+
+static void gl2_set_texture_filter(int32_t texture_id, qu_texture_filter filter)
+{
+    gl2__texture *texture = libqu_array_get(g_textures, texture_id);
+
+    if (!texture) {
+        return;
+    }
+
+    bool smooth;
+    GLenum min_filter;
+
+    switch (filter) {
+    case QU_TEXTURE_FILTER_NEAREST:
+        smooth = false;
+        min_filter = GL_NEAREST;
+        break;
+    case QU_TEXTURE_FILTER_LINEAR:
+        smooth = true;
+        min_filter = GL_LINEAR;
+        break;
+    case QU_TEXTURE_FILTER_MIPMAP:
+        smooth = true;
+        min_filter = GL_LINEAR_MIPMAP_LINEAR;
+        break;
+    default:
+        return;
+    }
+
+    gl2__lock_resources();
+    texture->smooth = smooth;
+    texture->min_filter = min_filter;
+    gl2__unlock_resources();
+
+    gl2__update_texture_filter(texture_id);
+}
+
+/**
+ * Look up texture for a draw command and copy it to `copy`.
+ * Command lists may be recorded on other threads while the main thread
+ * adds textures, so they take the lock for the lookup.
+ * Returns `copy`, or NULL if there is no such texture.
+ */
+static gl2__texture *gl2__get_texture_copy(int32_t texture_id, gl2__texture *copy)
+{
+    bool lock = t_cmd_list && t_context_depth == 0;
+
+    if (lock) {
+        gl2__lock_resources();
+    }
+
+    gl2__texture *texture = libqu_array_get(g_textures, texture_id);
+
+    if (texture) {
+        *copy = *texture;
+    }
+
+    if (lock) {
+        gl2__unlock_resources();
+    }
+
+    return texture ? copy : NULL;
+}
+
+/**
+ * Get texture which should be bound to draw the given one: either itself,
+ * the atlas page it's packed into, or the placeholder if it isn't loaded.
+ */
+static int32_t gl2__get_draw_texture(int32_t texture_id, gl2__texture const *texture)
+{
+    if (texture->atlas_id) {
+        return texture->atlas_id;
+    }
+
+    if (texture->job || !texture->handle) {
+        return g_state.placeholder_id;
+    }
+
+    return texture_id;
+}
+
+/**
+ * Reserve source rectangles for `count` quads or instances of a textured
+ * draw recorded into a mesh. Returns NULL if no mesh is being recorded.
+ * `failed` is set if the rectangles can't be allocated.
+ */
+static gl2__source_rect *gl2__alloc_source_rects(int count, bool *failed)
+{
+    *failed = false;
+
+    if (!t_mesh_list) {
+        return NULL;
+    }
+
+    gl2__vertex_array *buffer = &t_mesh_list->rects;
+    unsigned int required = buffer->size + sizeof(gl2__source_rect) * count;
+
+    if (!gl2__reserve_vertices(buffer, required)) {
+        *failed = true;
+        return NULL;
+    }
+
+    gl2__source_rect *rects = (gl2__source_rect *) (buffer->array + buffer->size);
+    buffer->size = required;
+
+    return rects;
+}
+
+/**
+ * Append draw command of the texture. Meshes keep the texture itself,
+ * its placement is resolved when the mesh is drawn.
+ */
+static void gl2__append_texture_draw(int32_t texture_id, gl2__texture const *texture,
+                                     gl2__cmd_draw *draw)
+{
+    if (t_mesh_list) {
+        draw->texture_id = texture_id;
+        draw->resolve = true;
+    } else {
+        draw->texture_id = gl2__get_draw_texture(texture_id, texture);
+    }
+
+    gl2__append_command(GL2__CMD_DRAW, draw);
+}
+
+static void gl2_draw_texture(int32_t texture_id, float x, float y, float w, float h)
+{
+    gl2__texture copy;
+    gl2__texture *texture = gl2__get_texture_copy(texture_id, &copy);
+
+    if (!texture || !gl2__is_visible(x, y, w, h)) {
+        return;
+    }
+
+    bool failed;
+    gl2__source_rect *rect = gl2__alloc_source_rects(1, &failed);
+
+    if (failed) {
+        return;
+    }
+
+    if (rect) {
+        *rect = (gl2__source_rect) { .whole_w = true, .whole_h = true };
+    }
+
+    float s0 = texture->s0, t0 = texture->t0;
+    float s1 = texture->s1, t1 = texture->t1;
+
+    float vertices[] = {
+        x,      y,      s0,     t0,
+        x + w,  y,      s1,     t0,
+        x + w,  y + h,  s1,     t1,
+        x,      y + h,  s0,     t1,
+    };
+
+    gl2__append_texture_draw(texture_id, texture, &(gl2__cmd_draw) {
+        .color = 0xffffffff,
+        .program = GL2__PROG_TEXTURE,
+        .format = GL2__VF_TEXTURED_COLORED,
+        .mode = GL_TRIANGLES,
+        .first = gl2__append_textured_vertices(vertices, 4, 0xffffffff),
+        .count = 4,
+        .indexed = true,
+    });
+}
+
+static void gl2_draw_subtexture(int32_t texture_id, float x, float y, float w,
+                                float h, float rx, float ry, float rw, float rh)
+{
+    gl2__texture copy;
+    gl2__texture *texture = gl2__get_texture_copy(texture_id, &copy);
+
+    if (!texture || !gl2__is_visible(x, y, w, h)) {
+        return;
+    }
+
+    bool failed;
+    gl2__source_rect *rect = gl2__alloc_source_rects(1, &failed);
+
+    if (failed) {
+        return;
+    }
+
+    if (rect) {
+        *rect = (gl2__source_rect) { .x = rx, .y = ry, .w = rw, .h = rh };
+    }
+
+    float iw = (texture->s1 - texture->s0) / texture->width;
+    float ih = (texture->t1 - texture->t0) / texture->height;
+
+    float s = texture->s0 + rx * iw;
+    float t = texture->t0 + ry * ih;
+    float u = rw * iw;
+    float v = rh * ih;
+
+    float vertices[] = {
+        x,      y,      s,      t,
+        x + w,  y,      s + u,  t,
+        x + w,  y + h,  s + u,  t + v,
+        x,      y + h,  s,      t + v,
+    };
+
+    gl2__append_texture_draw(texture_id, texture, &(gl2__cmd_draw) {
+        .color = 0xffffffff,
+        .program = GL2__PROG_TEXTURE,
+        .format = GL2__VF_TEXTURED_COLORED,
+        .mode = GL_TRIANGLES,
+        .first = gl2__append_textured_vertices(vertices, 4, 0xffffffff),
+        .count = 4,
+        .indexed = true,
+    });
+}
+
+static gl2__source_rect gl2__get_sprite_rect(qu_sprite const *sprite)
+{
+    return (gl2__source_rect) {
+        .x = sprite->rx,
+        .y = sprite->ry,
+        .w = sprite->rw,
+        .h = sprite->rh,
+        .whole_w = (sprite->rw == 0.f),
+        .whole_h = (sprite->rh == 0.f),
+    };
+}
+
+/**
+ * Append one GL2__VF_SPRITE instance per sprite,
+ * transformation is done in the vertex shader.
+ */
+static void gl2__draw_sprite_instances(int32_t texture_id, gl2__texture *texture,
+                                       qu_sprite const *sprites, int count)
+{
+    int first;
+    gl2__sprite_instance *data =
+        gl2__alloc_vertices(GL2__VF_SPRITE, count, &first);
+
+    if (!data) {
+        return;
+    }
+
+    bool failed;
+    gl2__source_rect *rects = gl2__alloc_source_rects(count, &failed);
+
+    if (failed) {
+        return;
+    }
+
+    float tw = texture->width;
+    float th = texture->height;
+    float iw = (texture->s1 - texture->s0) / tw;
+    float ih = (texture->t1 - texture->t0) / th;
+    float s0 = texture->s0;
+    float t0 = texture->t0;
+
+    for (int i = 0; i < count; i++) {
+        qu_sprite const *sprite = &sprites[i];
+        gl2__sprite_instance *instance = &data[i];
+
+        float rw = (sprite->rw == 0.f) ? tw : sprite->rw;
+        float rh = (sprite->rh == 0.f) ? th : sprite->rh;
+
+        if (rects) {
+            rects[i] = gl2__get_sprite_rect(sprite);
+        }
+
+        gl2__pack_color(sprite->color, instance->color);
+
+        instance->x = sprite->x + sprite->w * 0.5f;
+        instance->y = sprite->y + sprite->h * 0.5f;
+        instance->w = sprite->w;
+        instance->h = sprite->h;
+
+        instance->s0 = gl2__pack_texcoord(s0 + sprite->rx * iw);
+        instance->t0 = gl2__pack_texcoord(t0 + sprite->ry * ih);
+        instance->s1 = gl2__pack_texcoord(s0 + (sprite->rx + rw) * iw);
+        instance->t1 = gl2__pack_texcoord(t0 + (sprite->ry + rh) * ih);
+
+        instance->rotation = QU_DEG2RAD(sprite->rotation);
+    }
+
+    gl2__append_texture_draw(texture_id, texture, &(gl2__cmd_draw) {
+        .color = 0xffffffff,
+        .program = GL2__PROG_SPRITE,
+        .format = GL2__VF_SPRITE,
+        .mode = GL_TRIANGLES,
+        .first = first,
+        .count = count,
+        .instanced = true,
+    });
+}
+
+static void gl2_draw_sprites(int32_t texture_id, qu_sprite const *sprites, int count)
+{
+    gl2__texture copy;
+    gl2__texture *texture = gl2__get_texture_copy(texture_id, &copy);
+
+    if (!texture || count <= 0) {
+        return;
+    }
+
+    // Baked transformations have to be applied to every vertex on CPU,
+    // so in that case sprites are expanded to quads as well.
+    if (g_caps.instanced_arrays && !g_state.bake_transforms) {
+        gl2__draw_sprite_instances(texture_id, texture, sprites, count);
+        return;
+    }
+
+    int first;
+    gl2__textured_vertex *data =
+        gl2__alloc_vertices(GL2__VF_TEXTURED_COLORED, count * 4, &first);
+
+    if (!data) {
+        return;
+    }
+
+    bool failed;
+    gl2__source_rect *rects = gl2__alloc_source_rects(count, &failed);
+
+    if (failed) {
+        return;
+    }
+
+    gl2__textured_vertex *v = data;
+
+    float tw = texture->width;
+    float th = texture->height;
+    float iw = (texture->s1 - texture->s0) / tw;
+    float ih = (texture->t1 - texture->t0) / th;
+    float s0 = texture->s0;
+    float t0 = texture->t0;
+
+    for (int i = 0; i < count; i++) {
+        qu_sprite const *sprite = &sprites[i];
+
+        float rw = (sprite->rw == 0.f) ? tw : sprite->rw;
+        float rh = (sprite->rh == 0.f) ? th : sprite->rh;
+
+        if (rects) {
+            rects[i] = gl2__get_sprite_rect(sprite);
+        }
+
+        GLushort ps0 = gl2__pack_texcoord(s0 + sprite->rx * iw);
+        GLushort pt0 = gl2__pack_texcoord(t0 + sprite->ry * ih);
+        GLushort ps1 = gl2__pack_texcoord(s0 + (sprite->rx + rw) * iw);
+        GLushort pt1 = gl2__pack_texcoord(t0 + (sprite->ry + rh) * ih);
+
+        // Corners relative to the center of the sprite.
+        float hw = sprite->w * 0.5f;
+        float hh = sprite->h * 0.5f;
+        float cx = sprite->x + hw;
+        float cy = sprite->y + hh;
+
+        float ax = -hw, ay = -hh;
+        float bx = +hw, by = -hh;
+        float ex = +hw, ey = +hh;
+        float dx = -hw, dy = +hh;
+
+        if (sprite->rotation != 0.f) {
+            float rad = QU_DEG2RAD(sprite->rotation);
+            float c = cosf(rad);
+            float s = sinf(rad);
+
+            ax = -hw * c + hh * s;  ay = -hw * s - hh * c;
+            bx = +hw * c + hh * s;  by = +hw * s - hh * c;
+            ex = -ax;               ey = -ay;
+            dx = -bx;               dy = -by;
+        }
+
+        GLubyte c[4];
+        gl2__pack_color(sprite->color, c);
+
+        *v++ = (gl2__textured_vertex) { cx + ax, cy + ay, { c[0], c[1], c[2], c[3] }, ps0, pt0 };
+        *v++ = (gl2__textured_vertex) { cx + bx, cy + by, { c[0], c[1], c[2], c[3] }, ps1, pt0 };
+        *v++ = (gl2__textured_vertex) { cx + ex, cy + ey, { c[0], c[1], c[2], c[3] }, ps1, pt1 };
+        *v++ = (gl2__textured_vertex) { cx + dx, cy + dy, { c[0], c[1], c[2], c[3] }, ps0, pt1 };
+    }
+
+    if (g_state.bake_transforms) {
+        gl2__bake_positions(data, count * 4, sizeof(gl2__textured_vertex));
+    }
+
+    gl2__append_texture_draw(texture_id, texture, &(gl2__cmd_draw) {
+        .color = 0xffffffff,
+        .program = GL2__PROG_TEXTURE,
+        .format = GL2__VF_TEXTURED_COLORED,
+        .mode = GL_TRIANGLES,
+        .first = first,
+        .count = count * 4,
+        .indexed = true,
+    });
+}
+
+//------------------------------------------------------------------------------
+// Particles
+
+/**
+ * Write particles as untextured squares.
+ */
+static void gl2__draw_solid_particles(float const *x, float const *y,
+                                      float const *size, qu_color const *color,
+                                      int count)
+{
+    int first;
+    gl2__solid_vertex *data =
+        gl2__alloc_vertices(GL2__VF_SOLID_COLORED, count * 4, &first);
+
+    if (!data) {
+        return;
+    }
+
+    gl2__solid_vertex *v = data;
+
+    for (int i = 0; i < count; i++) {
+        float h = size[i] * 0.5f;
+        float l = x[i] - h, r = x[i] + h;
+        float t = y[i] - h, b = y[i] + h;
+
+        GLubyte c[4];
+        gl2__pack_color(color[i], c);
+
+        *v++ = (gl2__solid_vertex) { l, t, { c[0], c[1], c[2], c[3] } };
+        *v++ = (gl2__solid_vertex) { r, t, { c[0], c[1], c[2], c[3] } };
+        *v++ = (gl2__solid_vertex) { r, b, { c[0], c[1], c[2], c[3] } };
+        *v++ = (gl2__solid_vertex) { l, b, { c[0], c[1], c[2], c[3] } };
+    }
+
+    if (g_state.bake_transforms) {
+        gl2__bake_positions(data, count * 4, sizeof(gl2__solid_vertex));
+    }
+
+    gl2__append_command(GL2__CMD_DRAW, &(gl2__cmd_draw) {
+        .color = 0xffffffff,
+        .program = GL2__PROG_SHAPE,
+        .format = GL2__VF_SOLID_COLORED,
+        .mode = GL_TRIANGLES,
+        .first = first,
+        .count = count * 4,
+        .indexed = true,
+    });
+}
+
+/**
+ * Record that `count` particles show the whole texture,
+ * if a mesh is being recorded.
+ */
+static bool gl2__record_whole_rects(int count)
+{
+    bool failed;
+    gl2__source_rect *rects = gl2__alloc_source_rects(count, &failed);
+
+    for (int i = 0; rects && i < count; i++) {
+        rects[i] = (gl2__source_rect) { .whole_w = true, .whole_h = true };
+    }
+
+    return !failed;
+}
+
+/**
+ * Write particles as sprite instances showing the whole texture.
+ */
+static void gl2__draw_particle_instances(int32_t texture_id, gl2__texture *texture,
+                                         float const *x, float const *y,
+                                         float const *size, qu_color const *color,
+                                         int count)
+{
+    int first;
+    gl2__sprite_instance *data =
+        gl2__alloc_vertices(GL2__VF_SPRITE, count, &first);
+
+    if (!data) {
+        return;
+    }
+
+    if (!gl2__record_whole_rects(count)) {
+        return;
+    }
+
+    GLushort s0 = gl2__pack_texcoord(texture->s0);
+    GLushort t0 = gl2__pack_texcoord(texture->t0);
+    GLushort s1 = gl2__pack_texcoord(texture->s1);
+    GLushort t1 = gl2__pack_texcoord(texture->t1);
+
+    for (int i = 0; i < count; i++) {
+        gl2__sprite_instance *instance = &data[i];
+
+        gl2__pack_color(color[i], instance->color);
+
+        instance->x = x[i];
+        instance->y = y[i];
+        instance->w = size[i];
+        instance->h = size[i];
+        instance->s0 = s0;
+        instance->t0 = t0;
+        instance->s1 = s1;
+        instance->t1 = t1;
+        instance->rotation = 0.f;
+    }
+
+    gl2__append_texture_draw(texture_id, texture, &(gl2__cmd_draw) {
+        .color = 0xffffffff,
+        .program = GL2__PROG_SPRITE,
+        .format = GL2__VF_SPRITE,
+        .mode = GL_TRIANGLES,
+        .first = first,
+        .count = count,
+        .instanced = true,
+    });
+}
+
+/**
+ * Particles are centered at (`x`, `y`) and are `size` pixels wide.
+ * All of them go into the vertex stream as one draw command.
+ */
+static void gl2_draw_particles(int32_t texture_id, float const *x, float const *y,
+                               float const *size, qu_color const *color, int count)
+{
+    if (count <= 0) {
+        return;
+    }
+
+    if (texture_id == 0) {
+        gl2__draw_solid_particles(x, y, size, color, count);
+        return;
+    }
+
+    gl2__texture copy;
+    gl2__texture *texture = gl2__get_texture_copy(texture_id, &copy);
+
+    if (!texture) {
+        return;
+    }
+
+    if (g_caps.instanced_arrays && !g_state.bake_transforms) {
+        gl2__draw_particle_instances(texture_id, texture, x, y, size, color, count);
+        return;
+    }
+
+    int first;
+    gl2__textured_vertex *data =
+        gl2__alloc_vertices(GL2__VF_TEXTURED_COLORED, count * 4, &first);
+
+    if (!data) {
+        return;
+    }
+
+    if (!gl2__record_whole_rects(count)) {
+        return;
+    }
+
+    gl2__textured_vertex *v = data;
+
+    GLushort s0 = gl2__pack_texcoord(texture->s0);
+    GLushort t0 = gl2__pack_texcoord(texture->t0);
+    GLushort s1 = gl2__pack_texcoord(texture->s1);
+    GLushort t1 = gl2__pack_texcoord(texture->t1);
+
+    for (int i = 0; i < count; i++) {
+        float h = size[i] * 0.5f;
+        float l = x[i] - h, r = x[i] + h;
+        float t = y[i] - h, b = y[i] + h;
+
+        GLubyte c[4];
+        gl2__pack_color(color[i], c);
+
+        *v++ = (gl2__textured_vertex) { l, t, { c[0], c[1], c[2], c[3] }, s0, t0 };
+        *v++ = (gl2__textured_vertex) { r, t, { c[0], c[1], c[2], c[3] }, s1, t0 };
+        *v++ = (gl2__textured_vertex) { r, b, { c[0], c[1], c[2], c[3] }, s1, t1 };
+        *v++ = (gl2__textured_vertex) { l, b, { c[0], c[1], c[2], c[3] }, s0, t1 };
+    }
+
+    if (g_state.bake_transforms) {
+        gl2__bake_positions(data, count * 4, sizeof(gl2__textured_vertex));
+    }
+
+    gl2__append_texture_draw(texture_id, texture, &(gl2__cmd_draw) {
+        .color = 0xffffffff,
+        .program = GL2__PROG_TEXTURE,
+        .format = GL2__VF_TEXTURED_COLORED,
+        .mode = GL_TRIANGLES,
+        .first = first,
+        .count = count * 4,
+        .indexed = true,
+    });
+}
+
+//------------------------------------------------------------------------------
+// Fonts
+
+static void gl2_draw_text(int32_t texture_id, qu_color color, float const *data, int count)
+{
+    gl2__append_command(GL2__CMD_DRAW, &(gl2__cmd_draw) {
+        .color = 0xffffffff,
+        .texture_id = texture_id,
+        .program = GL2__PROG_TEXTURE,
+        .format = GL2__VF_TEXTURED_COLORED,
+        .mode = GL_TRIANGLES,
+        .first = gl2__append_textured_vertices(data, count, color),
+        .count = count,
+        .indexed = true,
+    });
+}
+
+//------------------------------------------------------------------------------
+// Surfaces
+
+/**
+ * Create framebuffer objects of a new surface.
+ * The framebuffer is left bound.
+ */
+static bool gl2__init_surface(gl2__surface *surface, int width, int height,
+                              bool depth)
+{
+    glGenFramebuffers(1, &surface->handle);
+    glBindFramebuffer(GL_FRAMEBUFFER, surface->handle);
+
+    if (depth) {
+        glGenRenderbuffers(1, &surface->depth);
+        glBindRenderbuffer(GL_RENDERBUFFER, surface->depth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT16, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                                  GL_RENDERBUFFER, surface->depth);
+    }
+
+    surface->color_id = gl2_create_texture(width, height, 4);
+
+    if (surface->color_id == 0) {
+        gl2__surface_dtor(surface);
+        return false;
+    }
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    gl2__texture *texture = libqu_array_get(g_textures, surface->color_id);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                           texture->handle, 0);
+
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        libqu_error("Failed to create OpenGL framebuffer.\n");
+        gl2__surface_dtor(surface);
+        return false;
+    }
+
+    surface->width = width;
+    surface->height = height;
+
+    return true;
+}
+
+/**
+ * Take a deleted surface of the same size and attachments
+ * out of the pool.
+ */
+static bool gl2__take_pooled_surface(gl2__surface *surface, int width, int height,
+                                     bool depth)
+{
+    for (int i = 0; i < g_surface_pool_count; i++) {
+        gl2__surface *pooled = &g_surface_pool[i];
+
+        if (pooled->width != width || pooled->height != height ||
+            (pooled->depth != 0) != depth) {
+            continue;
+        }
+
+        *surface = *pooled;
+        g_surface_pool[i] = g_surface_pool[--g_surface_pool_count];
+
+        return true;
+    }
+
+    return false;
+}
+
+static int32_t gl2__create_surface(int width, int height, bool depth)
+{
+    if (width < 0 || height < 0) {
+        return 0;
+    }
+
+    gl2__surface surface = {0};
+
+    if (gl2__take_pooled_surface(&surface, width, height, depth)) {
+        int32_t id = libqu_array_add(g_surfaces, &surface);
+
+        if (id == 0) {
+            libqu_error("Failed to create surface: insufficient memory.\n");
+        }
+
+        return id;
+    }
+
+    if (!gl2__init_surface(&surface, width, height, depth)) {
+        // Framebuffer was bound before being deleted.
+        g_state.surface_id = 0;
+        g_cull.surface_id = -1;
+        g_cull.valid = false;
+        return 0;
+    }
+
+    g_state.surface_id = libqu_array_add(g_surfaces, &surface);
+
+    // Framebuffer is switched outside of the command stream.
+    g_cull.surface_id = -1;
+    g_cull.valid = false;
+
+    if (g_state.surface_id == 0) {
+        libqu_error("Failed to create surface: insufficient memory.\n");
+        return 0;
+    }
+
+    return g_state.surface_id;
+}
+
+static int32_t gl2_create_surface(int width, int height, bool depth)
+{
+    gl2__acquire_context();
+    int32_t id = gl2__create_surface(width, height, depth);
+    gl2__release_context();
+
+    return id;
+}
+
+static void gl2_delete_surface(int32_t id)
+{
+    gl2__acquire_context();
+
+    gl2__surface *surface = libqu_array_get(g_surfaces, id);
+
+    // Framebuffer and texture are handed over to the pool,
+    // so the destructor has nothing left to release.
+    if (surface && g_surface_pool_count < GL2__SURFACE_POOL_SIZE) {
+        g_surface_pool[g_surface_pool_count++] = *surface;
+        *surface = (gl2__surface) {0};
+    }
+
+    libqu_array_remove(g_surfaces, id);
+
+    gl2__release_context();
+}
+
+/**
+ * Reallocate storage of the surface, keeping its framebuffer.
+ * Contents of the surface are lost.
+ */
+static void gl2_resize_surface(int32_t id, int width, int height)
+{
+    if (width < 0 || height < 0) {
+        return;
+    }
+
+    gl2__acquire_context();
+
+    gl2__surface *surface = libqu_array_get(g_surfaces, id);
+    gl2__texture *texture = surface ? libqu_array_get(g_textures, surface->color_id) : NULL;
+
+    if (!texture || (surface->width == width && surface->height == height)) {
+        gl2__release_context();
+        return;
+    }
+
+    glBindTexture(GL_TEXTURE_2D, texture->handle);
+    glTexImage2D(GL_TEXTURE_2D, 0, texture->format, width, height,
+                 0, texture->format, GL_UNSIGNED_BYTE, NULL);
+
+    g_state.texture_id = surface->color_id;
+
+    texture->width = width;
+    texture->height = height;
+
+    if (surface->depth) {
+        glBindRenderbuffer(GL_RENDERBUFFER, surface->depth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT16, width, height);
+    }
+
+    surface->width = width;
+    surface->height = height;
+
+    // Bound surface keeps its state except for the size.
+    if (g_state.surface_id == id) {
+        glViewport(0, 0, width, height);
+        gl2__upd_projection(width / 2.f, height / 2.f, width, height, 0.f);
+    }
+
+    if (g_cull.surface_id == id) {
+        gl2__cull_invalidate();
+    }
+
+    gl2__release_context();
+}
+
+static void gl2_set_surface(int32_t id)
+{
+    // Changing surface restores transformation stack,
+    // see gl2__upd_surface().
+    if (g_state.bake_transforms) {
+        gl2__reset_baked_matrix(gl2__get_record_list());
+    }
+
+    if (!t_cmd_list) {
+        gl2__cull_set_surface(id);
+    }
+
+    gl2__append_command(GL2__CMD_SET_SURFACE, &(gl2__cmd_surface) {
+        .id = id,
+    });
+}
+
+static void gl2_reset_surface(void)
+{
+    if (g_state.bake_transforms) {
+        gl2__reset_baked_matrix(gl2__get_record_list());
+    }
+
+    if (!t_cmd_list) {
+        gl2__cull_set_surface(g_state.use_canvas ? g_state.canvas_id : 0);
+    }
+
+    gl2__append_command(GL2__CMD_RESET_SURFACE, NULL);
+}
+
+static void gl2_draw_surface(int32_t id, float x, float y, float w, float h)
+{
+    // See gl2__get_texture_copy().
+    bool lock = t_cmd_list && t_context_depth == 0;
+
+    if (lock) {
+        gl2__lock_resources();
+    }
+
+    gl2__surface *surface = libqu_array_get(g_surfaces, id);
+    int32_t color_id = surface ? surface->color_id : 0;
+
+    if (lock) {
+        gl2__unlock_resources();
+    }
+
+    if (!color_id) {
+        return;
+    }
+
+    float vertices[] = {
+        x,      y,      0.f,    1.f,
+        x + w,  y,      1.f,    1.f,
+        x + w,  y + h,  1.f,    0.f,
+        x,      y + h,  0.f,    0.f,
+    };
+
+    gl2__append_command(GL2__CMD_DRAW, &(gl2__cmd_draw) {
+        .color = 0xffffffff,
+        .texture_id = color_id,
+        .program = GL2__PROG_TEXTURE,
+        .format = GL2__VF_TEXTURED_COLORED,
+        .mode = GL_TRIANGLES,
+        .first = gl2__append_textured_vertices(vertices, 4, 0xffffffff),
+        .count = 4,
+        .indexed = true,
+    });
+}
+
+//------------------------------------------------------------------------------
+// Command lists
+
+/**
+ * Replace GL2__CMD_CALL_LIST records of `frame` with records of the called
+ * lists. Vertex data of each call is appended to the frame.
+ */
+static void gl2__splice_cmd_lists(gl2__cmd_list *frame)
+{
+    if (frame->calls == 0) {
+        return;
+    }
+
+    gl2__cmd_buf *output = &g_splice_buf;
+
+    output->size = 0;
+    output->count = 0;
+
+    unsigned char *record = frame->commands.data;
+    unsigned char *end = frame->commands.data + frame->commands.size;
+
+    while (record < end) {
+        gl2__cmd_header *header = (gl2__cmd_header *) record;
+        record += header->size;
+
+        if (header->type != GL2__CMD_CALL_LIST) {
+            if (gl2__reserve_commands(output, output->size + header->size)) {
+                memcpy(output->data + output->size, header, header->size);
+                output->size += header->size;
+                output->count++;
+            }
+
+            continue;
+        }
 
-    if (required > buffer->capacity) {
-        unsigned int next_capacity = buffer->capacity;
+        gl2__cmd_call const *call = GL2__CMD_PAYLOAD(header);
+        gl2__cmd_list **element = libqu_array_get(g_cmd_lists, call->id);
 
-        if (next_capacity == 0) {
-            next_capacity = 256;
+        if (!element) {
+            continue;
         }
 
-        while (next_capacity < required) {
-            next_capacity *= 2;
+        gl2__cmd_list *list = *element;
+
+        if (!gl2__reserve_commands(output, output->size + list->commands.size)) {
+            continue;
         }
 
-        float *next_array = realloc(buffer->array, sizeof(float) * next_capacity);
+        // Copy vertices first, so draw commands can be rebased.
+        int base[GL2__VF_TOTAL];
 
-        if (!next_array) {
-            return 0;
+        for (int i = 0; i < GL2__VF_TOTAL; i++) {
+            gl2__vertex_array *dst = &frame->vertices[i];
+            gl2__vertex_array const *src = &list->vertices[i];
+
+            base[i] = dst->size / g_vertex_bufs[i].stride;
+
+            if (src->size == 0) {
+                continue;
+            }
+
+            if (!gl2__reserve_vertices(dst, dst->size + src->size)) {
+                continue;
+            }
+
+            memcpy(dst->array + dst->size, src->array, src->size);
+            dst->size += src->size;
         }
 
-        libqu_debug("GLES 2.0: grow vertex array %d [%d -> %d]\n", format,
-                    buffer->capacity, next_capacity);
+        unsigned char *copy = output->data + output->size;
+        unsigned char *copy_end = copy + list->commands.size;
 
-        buffer->array = next_array;
-        buffer->capacity = next_capacity;
-    }
+        memcpy(copy, list->commands.data, list->commands.size);
 
-    memcpy(buffer->array + buffer->size, data, sizeof(float) * size);
+        while (copy < copy_end) {
+            gl2__cmd_header *copied = (gl2__cmd_header *) copy;
+            copy += copied->size;
 
-    int offset = buffer->size;
-    buffer->size += size;
+            if (copied->type == GL2__CMD_DRAW) {
+                gl2__cmd_draw *draw = GL2__CMD_PAYLOAD(copied);
+                draw->first += base[draw->format];
+            }
+        }
 
-    return offset;
-}
+        output->size += list->commands.size;
+        output->count += list->commands.count;
 
-//------------------------------------------------------------------------------
-// Views
+        if (list->layered) {
+            frame->layered = true;
+        }
+    }
 
-static void gl2_set_view(float x, float y, float w, float h, float rotation)
-{
-    gl2__append_command(&(gl2__cmd) {
-        .type = GL2__CMD_SET_VIEW,
-        .view = {
-            .x = x,
-            .y = y,
-            .w = w,
-            .h = h,
-            .r = rotation,
-        },
-    });
+    // Output becomes the command buffer of the frame, old buffer
+    // of the frame is reused next time.
+    gl2__cmd_buf commands = frame->commands;
+    frame->commands = *output;
+    *output = commands;
+
+    frame->calls = 0;
 }
 
-static void gl2_reset_view(void)
+static int32_t gl2_create_command_list(void)
 {
-    gl2__append_command(&(gl2__cmd) {
-        .type = GL2__CMD_RESET_VIEW,
-    });
-}
+    gl2__cmd_list *list = calloc(1, sizeof(gl2__cmd_list));
 
-//------------------------------------------------------------------------------
-// Transformation
+    if (!list) {
+        return 0;
+    }
 
-static void gl2_push_matrix(void)
-{
-    gl2__append_command(&(gl2__cmd) {
-        .type = GL2__CMD_PUSH_MATRIX,
-    });
+    list->outline_width = 1.f;
+    gl2__reset_baked_matrix(list);
+
+    return libqu_array_add(g_cmd_lists, &list);
 }
 
-static void gl2_pop_matrix(void)
+static void gl2_delete_command_list(int32_t id)
 {
-    gl2__append_command(&(gl2__cmd) {
-        .type = GL2__CMD_POP_MATRIX,
-    });
+    libqu_array_remove(g_cmd_lists, id);
 }
 
-static void gl2_translate(float x, float y)
+static void gl2_begin_command_list(int32_t id)
 {
-    gl2__append_command(&(gl2__cmd) {
-        .type = GL2__CMD_TRANSLATE,
-        .view.x = x,
-        .view.y = y,
-    });
+    if (t_cmd_list) {
+        libqu_warning("Command list is already being recorded on this thread.\n");
+        return;
+    }
+
+    gl2__cmd_list **element = libqu_array_get(g_cmd_lists, id);
+
+    if (!element) {
+        return;
+    }
+
+    gl2__cmd_list *list = *element;
+
+    list->commands.size = 0;
+    list->commands.count = 0;
+
+    for (int i = 0; i < GL2__VF_TOTAL; i++) {
+        list->vertices[i].size = 0;
+    }
+
+    list->layered = false;
+    list->layer = 0;
+    list->outline_width = 1.f;
+    gl2__reset_baked_matrix(list);
+
+    t_cmd_list = list;
 }
 
-static void gl2_scale(float x, float y)
+static void gl2_end_command_list(void)
 {
-    gl2__append_command(&(gl2__cmd) {
-        .type = GL2__CMD_SCALE,
-        .view.x = x,
-        .view.y = y,
-    });
+    if (t_mesh_list) {
+        libqu_warning("Mesh must be finished with qu_end_mesh().\n");
+        return;
+    }
+
+    t_cmd_list = NULL;
 }
 
-static void gl2_rotate(float degrees)
+static void gl2_draw_command_list(int32_t id)
 {
-    gl2__append_command(&(gl2__cmd) {
-        .type = GL2__CMD_ROTATE,
-        .view.r = degrees,
+    if (t_cmd_list) {
+        libqu_warning("Command lists can't draw other command lists.\n");
+        return;
+    }
+
+    gl2__append_command(GL2__CMD_CALL_LIST, &(gl2__cmd_call) {
+        .id = id,
     });
+
+    // The list may leave any surface, view and transformation behind.
+    gl2__cull_invalidate();
 }
 
 //------------------------------------------------------------------------------
-// Primitives
+// Tilemaps
 
-static void gl2_clear(qu_color color)
+static int32_t gl2_create_tilemap(int32_t texture_id, int tile_width, int tile_height,
+                                  int columns, int rows, int const *tiles)
 {
-    gl2__append_command(&(gl2__cmd) {
-        .type = GL2__CMD_CLEAR,
-        .clear = {
-            .color = color,
-        },
-    });
-}
+    if (tile_width <= 0 || tile_height <= 0 || columns <= 0 || rows <= 0) {
+        return 0;
+    }
 
-static void gl2_draw_point(float x, float y, qu_color color)
-{
-    float vertices[] = {
-        x, y,
+    int chunk_columns = (columns + GL2__TILEMAP_CHUNK_SIZE - 1) / GL2__TILEMAP_CHUNK_SIZE;
+    int chunk_rows = (rows + GL2__TILEMAP_CHUNK_SIZE - 1) / GL2__TILEMAP_CHUNK_SIZE;
+
+    gl2__tilemap tilemap = {
+        .texture_id = texture_id,
+        .tile_width = tile_width,
+        .tile_height = tile_height,
+        .columns = columns,
+        .rows = rows,
+        .tiles = malloc(sizeof(int) * columns * rows),
+        .chunks = calloc(chunk_columns * chunk_rows, sizeof(gl2__tilemap_chunk)),
+        .chunk_columns = chunk_columns,
+        .chunk_rows = chunk_rows,
+        .dirty = true,
     };
 
-    gl2__append_command(&(gl2__cmd) {
-        .type = GL2__CMD_DRAW,
-        .draw = {
-            .color = color,
-            .program = GL2__PROG_SHAPE,
-            .format = GL2__VF_SOLID,
-            .mode = GL_POINTS,
-            .first = gl2__append_vertex_data(GL2__VF_SOLID, vertices, 2) / 2,
-            .count = 2,
-        },
-    });
+    if (!tilemap.tiles || !tilemap.chunks) {
+        free(tilemap.tiles);
+        free(tilemap.chunks);
+        return 0;
+    }
+
+    if (tiles) {
+        memcpy(tilemap.tiles, tiles, sizeof(int) * columns * rows);
+    } else {
+        memset(tilemap.tiles, 0xff, sizeof(int) * columns * rows);
+    }
+
+    for (int i = 0; i < chunk_columns * chunk_rows; i++) {
+        tilemap.chunks[i].dirty = true;
+    }
+
+    gl2__acquire_context();
+    int32_t id = libqu_array_add(g_tilemaps, &tilemap);
+    gl2__release_context();
+
+    if (id == 0) {
+        free(tilemap.tiles);
+        free(tilemap.chunks);
+        return 0;
+    }
+
+    g_tilemap_count++;
+
+    return id;
 }
 
-static void gl2_draw_line(float ax, float ay, float bx, float by, qu_color color)
+static void gl2_delete_tilemap(int32_t id)
 {
-    float vertices[] = {
-        ax, ay,
-        bx, by,
-    };
+    if (!libqu_array_get(g_tilemaps, id)) {
+        return;
+    }
 
-    gl2__append_command(&(gl2__cmd) {
-        .type = GL2__CMD_DRAW,
-        .draw = {
-            .color = color,
-            .program = GL2__PROG_SHAPE,
-            .format = GL2__VF_SOLID,
-            .mode = GL_LINES,
-            .first = gl2__append_vertex_data(GL2__VF_SOLID, vertices, 4) / 2,
-            .count = 2,
-        },
-    });
+    gl2__acquire_context();
+    libqu_array_remove(g_tilemaps, id);
+    gl2__release_context();
+
+    g_tilemap_count--;
 }
 
-static void gl2_draw_triangle(float ax, float ay, float bx, float by,
-                              float cx, float cy, qu_color outline, qu_color fill)
+static void gl2_set_tile(int32_t id, int column, int row, int tile)
 {
-    int fill_alpha = (fill >> 24) & 255;
-    int outline_alpha = (outline >> 24) & 255;
+    gl2__tilemap *tilemap = libqu_array_get(g_tilemaps, id);
 
-    float vertices[] = {
-        ax, ay,
-        bx, by,
-        cx, cy,
-    };
+    if (!tilemap) {
+        return;
+    }
 
-    int first = gl2__append_vertex_data(GL2__VF_SOLID, vertices, 6) / 2;
+    if (column < 0 || column >= tilemap->columns || row < 0 || row >= tilemap->rows) {
+        return;
+    }
 
-    if (fill_alpha > 0) {
-        gl2__append_command(&(gl2__cmd) {
-            .type = GL2__CMD_DRAW,
-            .draw = {
-                .color = fill,
-                .program = GL2__PROG_SHAPE,
-                .format = GL2__VF_SOLID,
-                .mode = GL_TRIANGLE_FAN,
-                .first = first,
-                .count = 3,
-            },
-        });
+    int *dst = &tilemap->tiles[row * tilemap->columns + column];
+
+    if (*dst == tile) {
+        return;
     }
 
-    if (outline_alpha > 0) {
-        gl2__append_command(&(gl2__cmd) {
-            .type = GL2__CMD_DRAW,
-            .draw = {
-                .color = outline,
-                .program = GL2__PROG_SHAPE,
-                .format = GL2__VF_SOLID,
-                .mode = GL_LINE_LOOP,
-                .first = first,
-                .count = 3,
-            },
-        });
+    *dst = tile;
+
+    int chunk = (row / GL2__TILEMAP_CHUNK_SIZE) * tilemap->chunk_columns
+              + (column / GL2__TILEMAP_CHUNK_SIZE);
+
+    tilemap->chunks[chunk].dirty = true;
+    tilemap->dirty = true;
+}
+
+static void gl2_draw_tilemap(int32_t id, float x, float y)
+{
+    gl2__cmd_tilemap command = { .id = id };
+
+    if (g_state.bake_transforms) {
+        qu_mat4_copy(&command.matrix, gl2__get_baked_matrix());
+    } else {
+        qu_mat4_identity(&command.matrix);
     }
+
+    qu_mat4_translate(&command.matrix, x, y, 0.f);
+
+    gl2__append_command(GL2__CMD_DRAW_TILEMAP, &command);
 }
 
-static void gl2_draw_rectangle(float x, float y, float w, float h,
-                               qu_color outline, qu_color fill)
+/**
+ * Fill VBO of the chunk with one quad per non-empty tile. `vertices`
+ * must have room for all tiles of a chunk.
+ */
+static void gl2__build_tilemap_chunk(gl2__tilemap *tilemap, gl2__texture const *texture,
+                                     int index, gl2__textured_vertex *vertices)
 {
-    int fill_alpha = (fill >> 24) & 255;
-    int outline_alpha = (outline >> 24) & 255;
+    gl2__tilemap_chunk *chunk = &tilemap->chunks[index];
 
-    float vertices[] = {
-        x, y,
-        x + w, y,
-        x + w, y + h,
-        x, y + h,
-    };
+    int tileset_columns = texture->width / tilemap->tile_width;
+    int tileset_size = tileset_columns * (texture->height / tilemap->tile_height);
 
-    int first = gl2__append_vertex_data(GL2__VF_SOLID, vertices, 8) / 2;
+    float iw = (texture->s1 - texture->s0) / texture->width;
+    float ih = (texture->t1 - texture->t0) / texture->height;
+    float u = tilemap->tile_width * iw;
+    float v = tilemap->tile_height * ih;
 
-    if (fill_alpha > 0) {
-        gl2__append_command(&(gl2__cmd) {
-            .type = GL2__CMD_DRAW,
-            .draw = {
-                .color = fill,
-                .program = GL2__PROG_SHAPE,
-                .format = GL2__VF_SOLID,
-                .mode = GL_TRIANGLE_FAN,
-                .first = first,
-                .count = 4,
-            },
-        });
+    int column0 = (index % tilemap->chunk_columns) * GL2__TILEMAP_CHUNK_SIZE;
+    int row0 = (index / tilemap->chunk_columns) * GL2__TILEMAP_CHUNK_SIZE;
+    int column1 = QU_MIN(column0 + GL2__TILEMAP_CHUNK_SIZE, tilemap->columns);
+    int row1 = QU_MIN(row0 + GL2__TILEMAP_CHUNK_SIZE, tilemap->rows);
+
+    gl2__textured_vertex *vertex = vertices;
+
+    for (int row = row0; row < row1; row++) {
+        for (int column = column0; column < column1; column++) {
+            int tile = tilemap->tiles[row * tilemap->columns + column];
+
+            if (tile < 0 || tile >= tileset_size) {
+                continue;
+            }
+
+            float x = column * tilemap->tile_width;
+            float y = row * tilemap->tile_height;
+            float w = tilemap->tile_width;
+            float h = tilemap->tile_height;
+            float s = texture->s0 + (tile % tileset_columns) * u;
+            float t = texture->t0 + (tile / tileset_columns) * v;
+
+            float quad[] = {
+                x,      y,      s,      t,
+                x + w,  y,      s + u,  t,
+                x + w,  y + h,  s + u,  t + v,
+                x,      y + h,  s,      t + v,
+            };
+
+            for (int i = 0; i < 4; i++) {
+                vertex[i].x = quad[4 * i + 0];
+                vertex[i].y = quad[4 * i + 1];
+                memset(vertex[i].color, 255, sizeof(vertex[i].color));
+                vertex[i].s = gl2__pack_texcoord(quad[4 * i + 2]);
+                vertex[i].t = gl2__pack_texcoord(quad[4 * i + 3]);
+            }
+
+            vertex += 4;
+        }
     }
 
-    if (outline_alpha > 0) {
-        gl2__append_command(&(gl2__cmd) {
-            .type = GL2__CMD_DRAW,
-            .draw = {
-                .color = outline,
-                .program = GL2__PROG_SHAPE,
-                .format = GL2__VF_SOLID,
-                .mode = GL_LINE_LOOP,
-                .first = first,
-                .count = 4,
-            },
-        });
+    chunk->quad_count = (vertex - vertices) / 4;
+    chunk->dirty = false;
+
+    if (chunk->quad_count == 0) {
+        return;
     }
+
+    if (!chunk->vbo) {
+        glGenBuffers(1, &chunk->vbo);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, chunk->vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(gl2__textured_vertex) * 4 * chunk->quad_count,
+                 vertices, GL_STATIC_DRAW);
 }
 
-static void gl2_draw_circle(float x, float y, float radius, qu_color outline, qu_color fill)
+/**
+ * Resolve tileset textures of tilemaps drawn in this frame and rebuild
+ * their chunks whose tiles or texture coordinates have changed.
+ * Tilemaps which aren't drawn are left dirty until they are.
+ */
+static void gl2__update_tilemaps(void)
 {
-    int fill_alpha = (fill >> 24) & 255;
-    int outline_alpha = (outline >> 24) & 255;
+    if (g_tilemap_count == 0) {
+        return;
+    }
 
-    float vertices[64];
-    qu_make_circle(x, y, radius, vertices, 32);
+    gl2__cmd_buf *buffer = &g_record_frame->commands;
+    unsigned char *record = buffer->data;
+    unsigned char *end = buffer->data + buffer->size;
 
-    int first = gl2__append_vertex_data(GL2__VF_SOLID, vertices, 64) / 2;
+    gl2__textured_vertex *vertices = NULL;
+    bool acquired = false;
 
-    if (fill_alpha > 0) {
-        gl2__append_command(&(gl2__cmd) {
-            .type = GL2__CMD_DRAW,
-            .draw = {
-                .color = fill,
-                .program = GL2__PROG_SHAPE,
-                .format = GL2__VF_SOLID,
-                .mode = GL_TRIANGLE_FAN,
-                .first = first,
-                .count = 32,
-            },
-        });
+    for (; record < end; record += ((gl2__cmd_header *) record)->size) {
+        gl2__cmd_header *header = (gl2__cmd_header *) record;
+
+        if (header->type != GL2__CMD_DRAW_TILEMAP) {
+            continue;
+        }
+
+        gl2__cmd_tilemap *command = GL2__CMD_PAYLOAD(header);
+        gl2__tilemap *tilemap = libqu_array_get(g_tilemaps, command->id);
+        gl2__texture *texture = tilemap
+            ? libqu_array_get(g_textures, tilemap->texture_id)
+            : NULL;
+
+        // Nothing is drawn until the tileset is loaded.
+        if (!texture || texture->job) {
+            command->id = 0;
+            continue;
+        }
+
+        command->texture_id = gl2__get_draw_texture(tilemap->texture_id, texture);
+
+        if (texture->s0 != tilemap->s0 || texture->t0 != tilemap->t0 ||
+            texture->s1 != tilemap->s1 || texture->t1 != tilemap->t1) {
+            for (int i = 0; i < tilemap->chunk_columns * tilemap->chunk_rows; i++) {
+                tilemap->chunks[i].dirty = true;
+            }
+
+            tilemap->s0 = texture->s0;
+            tilemap->t0 = texture->t0;
+            tilemap->s1 = texture->s1;
+            tilemap->t1 = texture->t1;
+            tilemap->dirty = true;
+        }
+
+        if (!tilemap->dirty) {
+            continue;
+        }
+
+        if (!vertices) {
+            int size = GL2__TILEMAP_CHUNK_SIZE * GL2__TILEMAP_CHUNK_SIZE * 4;
+            vertices = malloc(sizeof(gl2__textured_vertex) * size);
+
+            if (!vertices) {
+                break;
+            }
+        }
+
+        if (!acquired) {
+            gl2__acquire_context();
+            acquired = true;
+        }
+
+        for (int i = 0; i < tilemap->chunk_columns * tilemap->chunk_rows; i++) {
+            if (tilemap->chunks[i].dirty) {
+                gl2__build_tilemap_chunk(tilemap, texture, i, vertices);
+            }
+        }
+
+        tilemap->dirty = false;
     }
 
-    if (outline_alpha > 0) {
-        gl2__append_command(&(gl2__cmd) {
-            .type = GL2__CMD_DRAW,
-            .draw = {
-                .color = outline,
-                .program = GL2__PROG_SHAPE,
-                .format = GL2__VF_SOLID,
-                .mode = GL_LINE_LOOP,
-                .first = first,
-                .count = 32,
-            },
-        });
+    if (acquired) {
+        gl2__release_context();
     }
+
+    free(vertices);
 }
 
 //------------------------------------------------------------------------------
-// Textures
+// Meshes
 
-static int32_t gl2_create_texture(int width, int height, int channels)
+/**
+ * Number of quads or instances drawn by the command.
+ */
+static int gl2__get_quad_count(gl2__cmd_draw const *command)
 {
-    if ((width < 0) || (height < 0)) {
-        return 0;
-    }
+    return command->instanced ? command->count : command->count / 4;
+}
 
-    if ((channels < 1) || (channels > 4)) {
-        return 0;
+/**
+ * Rewrite texture coordinates of a textured draw of the mesh
+ * for the current placement of its texture.
+ */
+static void gl2__build_mesh_draw(gl2__mesh *mesh, gl2__mesh_draw const *draw,
+                                 gl2__cmd_draw const *command,
+                                 gl2__texture const *texture)
+{
+    float tw = texture->width;
+    float th = texture->height;
+    float iw = (texture->s1 - texture->s0) / tw;
+    float ih = (texture->t1 - texture->t0) / th;
+
+    for (int i = 0; i < gl2__get_quad_count(command); i++) {
+        gl2__source_rect const *rect = &mesh->rects[draw->rect + i];
+
+        float rw = rect->whole_w ? tw : rect->w;
+        float rh = rect->whole_h ? th : rect->h;
+
+        GLushort s0 = gl2__pack_texcoord(texture->s0 + rect->x * iw);
+        GLushort t0 = gl2__pack_texcoord(texture->t0 + rect->y * ih);
+        GLushort s1 = gl2__pack_texcoord(texture->s0 + (rect->x + rw) * iw);
+        GLushort t1 = gl2__pack_texcoord(texture->t0 + (rect->y + rh) * ih);
+
+        if (command->instanced) {
+            gl2__sprite_instance *instance =
+                (gl2__sprite_instance *) mesh->vertices[GL2__VF_SPRITE] +
+                command->first + i;
+
+            instance->s0 = s0;
+            instance->t0 = t0;
+            instance->s1 = s1;
+            instance->t1 = t1;
+        } else {
+            gl2__textured_vertex *v =
+                (gl2__textured_vertex *) mesh->vertices[GL2__VF_TEXTURED_COLORED] +
+                command->first + i * 4;
+
+            v[0].s = s0;    v[0].t = t0;
+            v[1].s = s1;    v[1].t = t0;
+            v[2].s = s1;    v[2].t = t1;
+            v[3].s = s0;    v[3].t = t1;
+        }
     }
+}
 
-    GLenum format = gl2__get_texture_format(channels);
+/**
+ * Point textured draws of the mesh to the textures they have to bind,
+ * and rebuild texture coordinates of those whose texture was loaded or
+ * moved since. Changed vertices are uploaded if `upload` is set,
+ * which needs the GL context.
+ */
+static void gl2__resolve_mesh(gl2__mesh *mesh, bool upload)
+{
+    for (int i = 0; i < mesh->draw_count; i++) {
+        gl2__mesh_draw *draw = &mesh->draws[i];
+        gl2__cmd_draw *command =
+            GL2__CMD_PAYLOAD(mesh->commands.data + draw->offset);
+        gl2__texture *texture = libqu_array_get(g_textures, draw->texture_id);
 
-    if (format == GL_INVALID_ENUM) {
-        return 0;
-    }
+        // Deleted textures are drawn with the placeholder.
+        if (!texture) {
+            command->texture_id = g_state.placeholder_id;
+            continue;
+        }
 
-    gl2__texture texture = {0};
+        command->texture_id = gl2__get_draw_texture(draw->texture_id, texture);
 
-    glGenTextures(1, &texture.handle);
+        if (texture->s0 == draw->s0 && texture->t0 == draw->t0 &&
+            texture->s1 == draw->s1 && texture->t1 == draw->t1 &&
+            (int) texture->width == draw->width &&
+            (int) texture->height == draw->height) {
+            continue;
+        }
 
-    glBindTexture(GL_TEXTURE_2D, texture.handle);
-    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height,
-                 0, format, GL_UNSIGNED_BYTE, NULL);
+        gl2__build_mesh_draw(mesh, draw, command, texture);
 
-    texture.width = width;
-    texture.height = height;
-    texture.channels = channels;
-    texture.format = format;
+        draw->s0 = texture->s0;
+        draw->t0 = texture->t0;
+        draw->s1 = texture->s1;
+        draw->t1 = texture->t1;
+        draw->width = texture->width;
+        draw->height = texture->height;
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        if (!upload) {
+            continue;
+        }
 
-    g_state.texture_id = libqu_array_add(g_textures, &texture);
+        int format = command->format;
+        unsigned int stride = g_vertex_bufs[format].stride;
 
-    if (g_state.texture_id > 0) {
-        libqu_info("Created texture 0x%08x.\n", g_state.texture_id);
+        glBindBuffer(GL_ARRAY_BUFFER, mesh->vbo[format]);
+        glBufferSubData(GL_ARRAY_BUFFER, command->first * stride,
+                        command->count * stride,
+                        mesh->vertices[format] + command->first * stride);
     }
-
-    return g_state.texture_id;
 }
 
-static void gl2_update_texture(int32_t texture_id, int x, int y, int w, int h,
-                               uint8_t const *pixels)
+/**
+ * Resolve textured draws of meshes drawn in this frame.
+ */
+static void gl2__update_meshes(void)
 {
-    gl2__texture *texture = libqu_array_get(g_textures, texture_id);
+    gl2__cmd_buf *buffer = &g_record_frame->commands;
+    unsigned char *record = buffer->data;
+    unsigned char *end = buffer->data + buffer->size;
 
-    if (!texture) {
-        return;
-    }
+    bool acquired = false;
 
-    glBindTexture(GL_TEXTURE_2D, texture->handle);
+    for (; record < end; record += ((gl2__cmd_header *) record)->size) {
+        gl2__cmd_header *header = (gl2__cmd_header *) record;
 
-    if (x == 0 && y == 0 && w == -1 && h == -1) {
-        glTexImage2D(GL_TEXTURE_2D, 0, texture->format,
-                     texture->width, texture->height, 0,
-                     texture->format, GL_UNSIGNED_BYTE, pixels);
-    } else {
-        glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h,
-                        texture->format, GL_UNSIGNED_BYTE, pixels);
-    }
+        if (header->type != GL2__CMD_DRAW_MESH) {
+            continue;
+        }
 
-    g_state.texture_id = texture_id;
-}
+        gl2__cmd_mesh const *command = GL2__CMD_PAYLOAD(header);
+        gl2__mesh *mesh = libqu_array_get(g_meshes, command->id);
 
-static int32_t gl2_load_texture(libqu_file *file)
-{
-    libqu_image *image = libqu_load_image(file);
-    libqu_fclose(file);
+        if (!mesh || mesh->draw_count == 0) {
+            continue;
+        }
 
-    if (!image) {
-        return 0;
-    }
+        if (!acquired) {
+            gl2__acquire_context();
+            acquired = true;
+        }
 
-    GLenum format = gl2__get_texture_format(image->channels);
+        gl2__resolve_mesh(mesh, true);
+    }
 
-    if (format == GL_INVALID_ENUM) {
-        libqu_delete_image(image);
-        return 0;
+    if (acquired) {
+        gl2__release_context();
     }
+}
+
+/**
+ * Find textured draws among commands of the new mesh, and take over
+ * their source rectangles and vertices from the recorded list.
+ * Placement of textures is left unknown, so that texture coordinates
+ * are built on first resolve.
+ */
+static bool gl2__init_mesh_draws(gl2__mesh *mesh, gl2__cmd_list *list)
+{
+    unsigned char *record = mesh->commands.data;
+    unsigned char *end = mesh->commands.data + mesh->commands.size;
+    int rect_count = 0;
 
-    gl2__texture texture = {0};
+    for (; record < end; record += ((gl2__cmd_header *) record)->size) {
+        gl2__cmd_header *header = (gl2__cmd_header *) record;
+        gl2__cmd_draw const *command = GL2__CMD_PAYLOAD(header);
 
-    glGenTextures(1, &texture.handle);
+        if (header->type == GL2__CMD_DRAW && command->resolve) {
+            rect_count += gl2__get_quad_count(command);
+            mesh->draw_count++;
+        }
+    }
 
-    glBindTexture(GL_TEXTURE_2D, texture.handle);
-    glTexImage2D(GL_TEXTURE_2D, 0, format, image->width, image->height,
-                 0, format, GL_UNSIGNED_BYTE, image->pixels);
+    if (mesh->draw_count == 0) {
+        return true;
+    }
 
-    texture.width = image->width;
-    texture.height = image->height;
-    texture.channels = image->channels;
-    texture.format = format;
+    // Rectangles are missing if recording some of them failed.
+    if (list->rects.size != sizeof(gl2__source_rect) * rect_count) {
+        return false;
+    }
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    mesh->draws = malloc(sizeof(gl2__mesh_draw) * mesh->draw_count);
 
-#ifdef __EMSCRIPTEN__
-    // I don't know what's going on, but without these parameters
-    // textures are rendered as black in WebGL
+    if (!mesh->draws) {
+        return false;
+    }
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-#endif
+    mesh->rects = (gl2__source_rect *) list->rects.array;
+    list->rects.array = NULL;
 
-    g_state.texture_id = libqu_array_add(g_textures, &texture);
+    mesh->vertices[GL2__VF_TEXTURED_COLORED] =
+        list->vertices[GL2__VF_TEXTURED_COLORED].array;
+    mesh->vertices[GL2__VF_SPRITE] = list->vertices[GL2__VF_SPRITE].array;
 
-    if (g_state.texture_id > 0) {
-        libqu_info("Loaded texture 0x%08x.\n", g_state.texture_id);
-    }
+    record = mesh->commands.data;
+    rect_count = 0;
 
-    libqu_delete_image(image);
+    for (int i = 0; record < end; record += ((gl2__cmd_header *) record)->size) {
+        gl2__cmd_header *header = (gl2__cmd_header *) record;
+        gl2__cmd_draw const *command = GL2__CMD_PAYLOAD(header);
 
-    return g_state.texture_id;
-}
+        if (header->type != GL2__CMD_DRAW || !command->resolve) {
+            continue;
+        }
 
-static void gl2_delete_texture(int32_t texture_id)
-{
-    gl2__texture *texture = libqu_array_get(g_textures, texture_id);
+        mesh->draws[i++] = (gl2__mesh_draw) {
+            .offset = record - mesh->commands.data,
+            .texture_id = command->texture_id,
+            .rect = rect_count,
+            .width = -1,
+        };
 
-    if (!texture) {
-        return;
+        rect_count += gl2__get_quad_count(command);
     }
 
-    libqu_array_remove(g_textures, texture_id);
+    return true;
 }
 
-static void gl2_set_texture_smooth(int32_t texture_id, bool smooth)
+static void gl2_begin_mesh(void)
 {
-    gl2__texture *texture = libqu_array_get(g_textures, texture_id);
-
-    if (!texture) {
+    if (t_cmd_list) {
+        libqu_warning("Can't begin mesh while recording a command list or mesh.\n");
         return;
     }
 
-    glBindTexture(GL_TEXTURE_2D, texture->handle);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, smooth ? GL_LINEAR : GL_NEAREST);
+    gl2__cmd_list *list = calloc(1, sizeof(gl2__cmd_list));
 
-    g_state.texture_id = texture_id;
-}
+    if (!list) {
+        return;
+    }
 
-static void gl2_draw_texture(int32_t texture_id, float x, float y, float w, float h)
-{
-    float vertices[] = {
-        x,      y,      0.f,    0.f,
-        x + w,  y,      1.f,    0.f,
-        x + w,  y + h,  1.f,    1.f,
-        x,      y + h,  0.f,    1.f,
-    };
+    list->outline_width = 1.f;
+    gl2__reset_baked_matrix(list);
 
-    gl2__append_command(&(gl2__cmd) {
-        .type = GL2__CMD_DRAW,
-        .draw = {
-            .color = 0xffffffff,
-            .texture_id = texture_id,
-            .program = GL2__PROG_TEXTURE,
-            .format = GL2__VF_TEXTURED,
-            .mode = GL_TRIANGLE_FAN,
-            .first = gl2__append_vertex_data(GL2__VF_TEXTURED, vertices, 16) / 4,
-            .count = 4,
-        },
-    });
+    t_cmd_list = t_mesh_list = list;
 }
 
-static void gl2_draw_subtexture(int32_t texture_id, float x, float y, float w,
-                                float h, float rx, float ry, float rw, float rh)
+/**
+ * Only draws and transformations are kept in the mesh. Draws are
+ * batched once here, vertex data is moved to VBOs of the mesh.
+ */
+static int32_t gl2_end_mesh(void)
 {
-    gl2__texture *texture = libqu_array_get(g_textures, texture_id);
+    gl2__cmd_list *list = t_mesh_list;
 
-    if (!texture) {
-        return;
+    if (!list) {
+        libqu_warning("qu_end_mesh() called without qu_begin_mesh().\n");
+        return 0;
     }
 
-    float s = rx / texture->width;
-    float t = ry / texture->height;
-    float u = rw / texture->width;
-    float v = rh / texture->height;
+    t_cmd_list = t_mesh_list = NULL;
 
-    float vertices[] = {
-        x,      y,      s,      t,
-        x + w,  y,      s + u,  t,
-        x + w,  y + h,  s + u,  t + v,
-        x,      y + h,  s,      t + v,
-    };
+    gl2__batch_commands(&list->commands);
 
-    gl2__append_command(&(gl2__cmd) {
-        .type = GL2__CMD_DRAW,
-        .draw = {
-            .color = 0xffffffff,
-            .texture_id = texture_id,
-            .program = GL2__PROG_TEXTURE,
-            .format = GL2__VF_TEXTURED,
-            .mode = GL_TRIANGLE_FAN,
-            .first = gl2__append_vertex_data(GL2__VF_TEXTURED, vertices, 16) / 4,
-            .count = 4,
+    gl2__mesh mesh = {
+        .commands = {
+            .data = malloc(list->commands.size ? list->commands.size : 1),
         },
-    });
-}
+    };
 
-//------------------------------------------------------------------------------
-// Fonts
+    if (!mesh.commands.data) {
+        gl2__free_cmd_list(list);
+        free(list);
+        return 0;
+    }
 
-static void gl2_draw_text(int32_t texture_id, qu_color color, float const *data, int count)
-{
-    gl2__append_command(&(gl2__cmd) {
-        .type = GL2__CMD_DRAW,
-        .draw = {
-            .color = color,
-            .texture_id = texture_id,
-            .program = GL2__PROG_TEXTURE,
-            .format = GL2__VF_TEXTURED,
-            .mode = GL_TRIANGLES,
-            .first = gl2__append_vertex_data(GL2__VF_TEXTURED, data, count * 4) / 4,
-            .count = count,
-        },
-    });
-}
+    unsigned char *record = list->commands.data;
+    unsigned char *end = list->commands.data + list->commands.size;
+    int skipped = 0;
+
+    for (; record < end; record += ((gl2__cmd_header *) record)->size) {
+        gl2__cmd_header *header = (gl2__cmd_header *) record;
+
+        switch (header->type) {
+        case GL2__CMD_DRAW:
+        case GL2__CMD_PUSH_MATRIX:
+        case GL2__CMD_POP_MATRIX:
+        case GL2__CMD_TRANSLATE:
+        case GL2__CMD_SCALE:
+        case GL2__CMD_ROTATE:
+            memcpy(mesh.commands.data + mesh.commands.size, record, header->size);
+            mesh.commands.size += header->size;
+            mesh.commands.count++;
+            break;
+        default:
+            skipped++;
+            break;
+        }
+    }
 
-//------------------------------------------------------------------------------
-// Surfaces
+    if (skipped > 0) {
+        libqu_warning("%d commands other than drawing and transformation "
+                      "are not kept in the mesh.\n", skipped);
+    }
 
-static int32_t gl2_create_surface(int width, int height)
-{
-    if (width < 0 || height < 0) {
+    if (!gl2__init_mesh_draws(&mesh, list)) {
+        libqu_error("Failed to record textured draws of the mesh.\n");
+        free(mesh.commands.data);
+        free(mesh.draws);
+        gl2__free_cmd_list(list);
+        free(list);
         return 0;
     }
 
-    gl2__surface surface = {0};
-
-    glGenFramebuffers(1, &surface.handle);
-    glBindFramebuffer(GL_FRAMEBUFFER, surface.handle);
+    // Vertices taken over by the mesh are kept after the list is freed.
+    for (int i = 0; i < GL2__VF_TOTAL; i++) {
+        if (mesh.vertices[i]) {
+            list->vertices[i].array = NULL;
+        }
+    }
 
-    glGenRenderbuffers(1, &surface.depth);
-    glBindRenderbuffer(GL_RENDERBUFFER, surface.depth);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT16, width, height);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
-                              GL_RENDERBUFFER, surface.depth);
+    gl2__acquire_context();
 
-    surface.color_id = gl2_create_texture(width, height, 4);
+    // Texture coordinates are built before the first upload.
+    gl2__resolve_mesh(&mesh, false);
 
-    if (surface.color_id == 0) {
-        glDeleteFramebuffers(1, &surface.handle);
-        return 0;
-    }
+    for (int i = 0; i < GL2__VF_TOTAL; i++) {
+        if (list->vertices[i].size == 0) {
+            continue;
+        }
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        unsigned char const *vertices =
+            mesh.vertices[i] ? mesh.vertices[i] : list->vertices[i].array;
 
-    gl2__texture *texture = libqu_array_get(g_textures, surface.color_id);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
-                           texture->handle, 0);
+        glGenBuffers(1, &mesh.vbo[i]);
+        glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo[i]);
+        glBufferData(GL_ARRAY_BUFFER, list->vertices[i].size,
+                     vertices, GL_STATIC_DRAW);
+    }
 
-    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    int32_t id = libqu_array_add(g_meshes, &mesh);
 
-    if (status != GL_FRAMEBUFFER_COMPLETE) {
-        libqu_error("Failed to create OpenGL framebuffer.\n");
-        return 0;
+    if (id == 0) {
+        gl2__mesh_dtor(&mesh);
     }
 
-    surface.width = width;
-    surface.height = height;
-
-    g_state.surface_id = libqu_array_add(g_surfaces, &surface);
+    gl2__release_context();
 
-    if (g_state.surface_id == 0) {
-        libqu_error("Failed to create surface: insufficient memory.\n");
-        return 0;
-    }
+    gl2__free_cmd_list(list);
+    free(list);
 
-    return g_state.surface_id;
+    return id;
 }
 
-static void gl2_delete_surface(int32_t id)
+static void gl2_delete_mesh(int32_t id)
 {
-    libqu_array_remove(g_surfaces, id);
+    gl2__acquire_context();
+    libqu_array_remove(g_meshes, id);
+    gl2__release_context();
 }
 
-static void gl2_set_surface(int32_t id)
+static void gl2_draw_mesh(int32_t id, float x, float y)
 {
-    gl2__append_command(&(gl2__cmd) {
-        .type = GL2__CMD_SET_SURFACE,
-        .surface.id = id,
-    });
-}
+    if (t_mesh_list) {
+        libqu_warning("Meshes can't draw other meshes.\n");
+        return;
+    }
 
-static void gl2_reset_surface(void)
-{
-    gl2__append_command(&(gl2__cmd) {
-        .type = GL2__CMD_RESET_SURFACE,
-    });
+    gl2__cmd_mesh command = { .id = id };
+
+    if (g_state.bake_transforms) {
+        qu_mat4_copy(&command.matrix, gl2__get_baked_matrix());
+    } else {
+        qu_mat4_identity(&command.matrix);
+    }
+
+    qu_mat4_translate(&command.matrix, x, y, 0.f);
+
+    gl2__append_command(GL2__CMD_DRAW_MESH, &command);
 }
 
-static void gl2_draw_surface(int32_t id, float x, float y, float w, float h)
+//------------------------------------------------------------------------------
+
+static void gl2__create_quad_index_buffer(void)
 {
-    gl2__surface *surface = libqu_array_get(g_surfaces, id);
+    GLushort *indices = malloc(sizeof(GLushort) * GL2__MAX_QUADS * 6);
 
-    if (!surface) {
-        return;
+    if (!indices) {
+        libqu_halt("Failed to initialize OpenGL");
     }
 
-    float vertices[] = {
-        x,      y,      0.f,    1.f,
-        x + w,  y,      1.f,    1.f,
-        x + w,  y + h,  1.f,    0.f,
-        x,      y + h,  0.f,    0.f,
-    };
+    for (int i = 0; i < GL2__MAX_QUADS; i++) {
+        indices[6 * i + 0] = 4 * i + 0;
+        indices[6 * i + 1] = 4 * i + 1;
+        indices[6 * i + 2] = 4 * i + 2;
+        indices[6 * i + 3] = 4 * i + 2;
+        indices[6 * i + 4] = 4 * i + 3;
+        indices[6 * i + 5] = 4 * i + 0;
+    }
 
-    gl2__append_command(&(gl2__cmd) {
-        .type = GL2__CMD_DRAW,
-        .draw = {
-            .color = 0xffffffff,
-            .texture_id = surface->color_id,
-            .program = GL2__PROG_TEXTURE,
-            .format = GL2__VF_TEXTURED,
-            .mode = GL_TRIANGLE_FAN,
-            .first = gl2__append_vertex_data(GL2__VF_TEXTURED, vertices, 16) / 4,
-            .count = 4,
-        },
-    });
+    glGenBuffers(1, &g_quad_ibo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_quad_ibo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLushort) * GL2__MAX_QUADS * 6,
+                 indices, GL_STATIC_DRAW);
+
+    free(indices);
 }
 
-//------------------------------------------------------------------------------
+static void gl2__create_unit_quad_buffer(void)
+{
+    GLfloat const vertices[] = {
+        0.f, 0.f,
+        1.f, 0.f,
+        1.f, 1.f,
+        0.f, 1.f,
+    };
+
+    glGenBuffers(1, &g_unit_quad_vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, g_unit_quad_vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+}
 
 static void gl2_initialize(qu_params const *params)
 {
+    g_record_frame = &g_frames[0];
+    g_render_frame = &g_frames[0];
+
     g_textures = libqu_create_array(sizeof(gl2__texture), gl2__texture_dtor);
     g_surfaces = libqu_create_array(sizeof(gl2__surface), gl2__surface_dtor);
+    g_cmd_lists = libqu_create_array(sizeof(gl2__cmd_list *), gl2__cmd_list_dtor);
+    g_tilemaps = libqu_create_array(sizeof(gl2__tilemap), gl2__tilemap_dtor);
+    g_meshes = libqu_create_array(sizeof(gl2__mesh), gl2__mesh_dtor);
+    g_resource_mutex = libqu_create_mutex();
 
-    if (!g_textures || !g_surfaces) {
+    if (!g_textures || !g_surfaces || !g_cmd_lists || !g_tilemaps || !g_meshes
+        || !g_resource_mutex) {
         libqu_halt("Failed to initialize OpenGL");
     }
 
-    GLuint shaders[GL2__SHADER_TOTAL];
+    if (g_caps.program_binary) {
+        GLint format_count = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count);
+        g_caps.program_binary = (format_count > 0);
+    }
 
-    for (int i = 0; i < GL2__SHADER_TOTAL; i++) {
-        shaders[i] = gl2__load_shader(&s_shaders[i]);
+    char const *cache_path = g_caps.program_binary ? params->shader_cache_path : NULL;
+    uint64_t cache_key = cache_path ? gl2__get_program_cache_key() : 0;
 
-        if (!shaders[i]) {
+    if (!cache_path || !gl2__load_program_cache(cache_path, cache_key)) {
+        if (!gl2__compile_programs()) {
             libqu_halt("Failed to initialize OpenGL");
         }
+
+        if (cache_path) {
+            gl2__save_program_cache(cache_path, cache_key);
+        }
     }
 
     for (int i = 0; i < GL2__PROG_TOTAL; i++) {
-        g_progs[i].handle =
-            gl2__build_program(s_progs[i].ident, shaders[s_progs[i].vs],
-                          shaders[s_progs[i].fs]);
-
         for (int j = 0; j < GL2__UNI_TOTAL; j++) {
             g_progs[i].uni_locations[j] =
                 glGetUniformLocation(g_progs[i].handle, s_uniform_names[j]);
@@ -1394,14 +6260,38 @@ static void gl2_initialize(qu_params const *params)
         g_progs[i].dirty = (uint32_t) -1;
     }
 
-    for (int i = 0; i < GL2__SHADER_TOTAL; i++) {
-        glDeleteShader(shaders[i]);
+    for (int i = 0; i < GL2__VF_TOTAL; i++) {
+        g_vertex_bufs[i].stride = gl2__get_vertex_stride(i);
+        glGenBuffers(GL2__VBO_RING_SIZE, g_vertex_bufs[i].vbo);
     }
 
-    for (int i = 0; i < GL2__VF_TOTAL; i++) {
-        glGenBuffers(1, &g_vertex_bufs[i].vbo);
+    gl2__create_quad_index_buffer();
+
+    // Pixel buffers are only worth it if they can be filled directly.
+    g_caps.pixel_buffer = g_caps.pixel_buffer && g_caps.map_buffer_range;
+
+    if (g_caps.pixel_buffer) {
+        glGenBuffers(GL2__PBO_RING_SIZE, g_upload_buf.pbo);
+    }
+
+    GLint max_texture_size = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_texture_size);
+
+    g_atlas.page_size = GL2__ATLAS_PAGE_SIZE;
+
+    if (max_texture_size > 0 && max_texture_size < g_atlas.page_size) {
+        g_atlas.page_size = max_texture_size;
+    }
+
+    if (g_caps.instanced_arrays) {
+        gl2__create_unit_quad_buffer();
     }
 
+    g_state.placeholder_id = gl2_create_texture(1, 1, 4);
+    gl2_update_texture(g_state.placeholder_id, 0, 0, -1, -1,
+                       (uint8_t const[]) { 0, 0, 0, 0 });
+    gl2__flush_uploads();
+
     g_state.use_canvas = params->enable_canvas;
 
     g_state.display_width = params->display_width;
@@ -1413,7 +6303,7 @@ static void gl2_initialize(qu_params const *params)
         g_state.canvas_height = params->canvas_height;
         g_state.canvas_aspect = params->canvas_width / (float) params->canvas_height;
 
-        g_state.canvas_id = gl2_create_surface(g_state.canvas_width, g_state.canvas_height);
+        g_state.canvas_id = gl2_create_surface(g_state.canvas_width, g_state.canvas_height, false);
 
         if (!g_state.canvas_id) {
             libqu_halt("Failed to initialize default framebuffer.\n");
@@ -1422,9 +6312,16 @@ static void gl2_initialize(qu_params const *params)
         gl2__upd_canvas_coords(g_state.display_width, g_state.display_height);
     }
 
-    gl2__append_command(&(gl2__cmd) {
-        .type = GL2__CMD_RESET_SURFACE,
-    });
+    g_display.width = g_state.display_width;
+    g_display.height = g_state.display_height;
+    g_display.aspect = g_state.display_aspect;
+
+    // Nothing is bound yet, so the first reset does restore the view.
+    g_cull.surface_id = g_state.use_canvas ? g_state.canvas_id : 0;
+    g_cull.transformed = false;
+    gl2__cull_reset_view();
+
+    gl2__append_command(GL2__CMD_RESET_SURFACE, NULL);
 
     g_state.texture_id = -1;
     g_state.surface_id = -1;
@@ -1440,42 +6337,141 @@ static void gl2_initialize(qu_params const *params)
     g_state.current_matrix = 0;
     qu_mat4_identity(&g_state.matrix[0]);
 
+    g_state.bake_transforms = params->bake_transforms;
+    gl2__reset_baked_matrix(g_record_frame);
+    g_record_frame->outline_width = 1.f;
+
     glClearColor(0.f, 0.f, 0.f, 0.f);
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
+    if (g_caps.map_buffer_range) {
+        libqu_info("Vertex data is uploaded with glMapBufferRange().\n");
+    }
+
+    if (g_caps.instanced_arrays) {
+        libqu_info("Sprites are drawn with instanced arrays.\n");
+    }
+
+    if (g_caps.pixel_buffer) {
+        libqu_info("Texture data is uploaded with pixel buffers.\n");
+    }
+
+    libqu_info("Compressed textures: S3TC %s, ETC1 %s, ETC2 %s.\n",
+               g_caps.texture_s3tc ? "yes" : "no",
+               (g_caps.texture_etc1 || g_caps.texture_etc2) ? "yes" : "no",
+               g_caps.texture_etc2 ? "yes" : "no");
+
     libqu_info("OpenGL 2.1 graphics module initialized.\n");
     libqu_info("OpenGL vendor: %s\n", glGetString(GL_VENDOR));
     libqu_info("OpenGL version: %s\n", glGetString(GL_VERSION));
     libqu_info("OpenGL renderer: %s\n", glGetString(GL_RENDERER));
+
+    if (params->render_thread) {
+        gl2__start_render_thread();
+    }
 }
 
 static void gl2_terminate(void)
 {
+    gl2__stop_render_thread();
+
+    free(g_pending_loads.ids);
+    memset(&g_pending_loads, 0, sizeof(g_pending_loads));
+
+    if (g_caps.pixel_buffer) {
+        glDeleteBuffers(GL2__PBO_RING_SIZE, g_upload_buf.pbo);
+    }
+
+    free(g_upload_buf.data);
+    free(g_upload_buf.uploads);
+    memset(&g_upload_buf, 0, sizeof(g_upload_buf));
+
+    libqu_destroy_array(g_cmd_lists);
+    libqu_destroy_array(g_tilemaps);
+    libqu_destroy_array(g_meshes);
     libqu_destroy_array(g_surfaces);
+
+    for (int i = 0; i < g_surface_pool_count; i++) {
+        gl2__surface_dtor(&g_surface_pool[i]);
+    }
+
+    g_surface_pool_count = 0;
+
     libqu_destroy_array(g_textures);
-    free(g_cmd_buf.array);
+
+    libqu_destroy_mutex(g_resource_mutex);
+    g_resource_mutex = NULL;
+
+    g_tilemap_count = 0;
+
+    for (int i = 0; i < g_atlas.page_count; i++) {
+        free(g_atlas.pages[i].pixels);
+        free(g_atlas.pages[i].skyline);
+    }
+
+    free(g_atlas.pages);
+    memset(&g_atlas, 0, sizeof(g_atlas));
+    free(g_sort_buf.items[0]);
+    free(g_sort_buf.items[1]);
+    free(g_sort_buf.data);
 
     for (int i = 0; i < GL2__PROG_TOTAL; i++) {
         glDeleteProgram(g_progs[i].handle);
     }
 
+    for (int i = 0; i < 2; i++) {
+        gl2__free_cmd_list(&g_frames[i]);
+    }
+
+    memset(g_frames, 0, sizeof(g_frames));
+    free(g_splice_buf.data);
+    memset(&g_splice_buf, 0, sizeof(g_splice_buf));
+
+    for (int i = 0; i < GL2__VF_TOTAL; i++) {
+        free(g_vertex_bufs[i].spare);
+        glDeleteBuffers(GL2__VBO_RING_SIZE, g_vertex_bufs[i].vbo);
+
+        for (int j = 0; j < GL2__VBO_RING_SIZE; j++) {
+            if (g_vertex_bufs[i].fence[j]) {
+                glDeleteSync(g_vertex_bufs[i].fence[j]);
+                g_vertex_bufs[i].fence[j] = NULL;
+            }
+        }
+    }
+
+    glDeleteBuffers(1, &g_quad_ibo);
+
+    if (g_unit_quad_vbo) {
+        glDeleteBuffers(1, &g_unit_quad_vbo);
+    }
+
     libqu_info("OpenGL 2.1 graphics module terminated.\n");
 }
 
 static void gl2_swap(void)
 {
+    // Canvas coordinates may be updated by the previous frame.
+    if (g_render_thread.thread) {
+        libqu_lock_mutex(g_render_thread.mutex);
+        gl2__wait_render_thread();
+        libqu_unlock_mutex(g_render_thread.mutex);
+    }
+
+    // Textures loaded in background become visible in the next frame.
+    gl2__finish_texture_loads();
+
     // If using canvas, then draw it in the default framebuffer
     if (g_state.use_canvas) {
-        gl2__append_command(&(gl2__cmd) {
-            .type = GL2__CMD_SET_SURFACE,
-            .surface.id = 0,
+        gl2__cull_set_surface(0);
+
+        gl2__append_command(GL2__CMD_SET_SURFACE, &(gl2__cmd_surface) {
+            .id = 0,
         });
 
-        gl2__append_command(&(gl2__cmd) {
-            .type = GL2__CMD_CLEAR,
-            .clear.color = 0xff000000,
+        gl2__append_command(GL2__CMD_CLEAR, &(gl2__cmd_clear) {
+            .color = 0xff000000,
         });
 
         gl2__surface *canvas = libqu_array_get(g_surfaces, g_state.canvas_id);
@@ -1487,74 +6483,79 @@ static void gl2_swap(void)
             g_state.canvas_ax, g_state.canvas_by, 0.f, 0.f,
         };
 
-        gl2__append_command(&(gl2__cmd) {
-            .type = GL2__CMD_DRAW,
-            .draw = {
-                .color = 0xffffffff,
-                .texture_id = canvas->color_id,
-                .program = GL2__PROG_TEXTURE,
-                .format = GL2__VF_TEXTURED,
-                .mode = GL_TRIANGLE_FAN,
-                .first = gl2__append_vertex_data(GL2__VF_TEXTURED, vertices, 16) / 4,
-                .count = 4,
-            },
+        gl2__append_command(GL2__CMD_DRAW, &(gl2__cmd_draw) {
+            .color = 0xffffffff,
+            .texture_id = canvas->color_id,
+            .program = GL2__PROG_TEXTURE,
+            .format = GL2__VF_TEXTURED,
+            .mode = GL_TRIANGLES,
+            .first = gl2__append_vertices(GL2__VF_TEXTURED, vertices, 4),
+            .count = 4,
+            .indexed = true,
         });
     }
 
-    // Upload vertex data to the GPU...
-    for (int i = 0; i < GL2__VF_TOTAL; i++) {
-        gl2__vertex_buf *buffer = &g_vertex_bufs[i];
+    // Insert command lists drawn during this frame
+    gl2__splice_cmd_lists(g_record_frame);
 
-        if (buffer->size == 0) {
-            continue;
-        }
+    // Rebuild changed chunks of tilemaps drawn during this frame
+    gl2__update_tilemaps();
 
-        glBindBuffer(GL_ARRAY_BUFFER, buffer->vbo);
+    // Textures drawn by meshes may have been loaded or moved
+    gl2__update_meshes();
 
-        if (buffer->size > buffer->vbo_size) {
-            glBufferData(GL_ARRAY_BUFFER, buffer->size * sizeof(float),
-                         buffer->array, GL_STREAM_DRAW);
-        } else {
-            glBufferSubData(GL_ARRAY_BUFFER, 0,
-                            buffer->size * sizeof(float),
-                            buffer->array);
-        }
+    // Texture updates of this frame, all at once
+    if (g_upload_buf.count > 0) {
+        gl2__acquire_context();
+        gl2__flush_uploads();
+        gl2__release_context();
+    }
 
-        buffer->size = 0;
+    if (g_render_thread.thread) {
+        gl2__submit_frame();
+    } else {
+        gl2__render_frame();
     }
 
-    // Force VBO pointer update
-    g_state.vertex_format = -1;
+    // Restore baked transformation
+    gl2__reset_baked_matrix(g_record_frame);
 
-    // Just in case
-    glFlush();
+    // Restore layer and outline width
+    g_record_frame->layer = 0;
+    g_record_frame->outline_width = 1.f;
 
-    // Execute all pending rendering commands...
-    for (unsigned int i = 0; i < g_cmd_buf.size; i++) {
-        gl2__execute_command(&g_cmd_buf.array[i]);
-    }
+    // Restore surface, transformation stack is restored after rendering
+    g_cull.transformed = false;
+    gl2__cull_set_surface(g_state.use_canvas ? g_state.canvas_id : 0);
+    gl2__append_command(GL2__CMD_RESET_SURFACE, NULL);
+}
 
-    // Reset size of the command buffer to 0
-    g_cmd_buf.size = 0;
+static qu_render_stats gl2_get_render_stats(void)
+{
+    gl2__render_thread *rt = &g_render_thread;
 
-    // Restore transformation stack
-    g_state.current_matrix = 0;
-    qu_mat4_identity(&g_state.matrix[0]);
-    gl2__upd_model_view();
+    if (!rt->thread) {
+        return g_state.stats;
+    }
 
-    // Restore surface
-    gl2__append_command(&(gl2__cmd) {
-        .type = GL2__CMD_RESET_SURFACE,
-        .surface.id = g_state.canvas_id,
-    });
+    libqu_lock_mutex(rt->mutex);
+    qu_render_stats stats = rt->stats;
+    libqu_unlock_mutex(rt->mutex);
+
+    return stats;
 }
 
 static void gl2_notify_display_resize(int width, int height)
 {
-    gl2__append_command(&(gl2__cmd) {
-        .type = GL2__CMD_RESIZE,
-        .size = { width, height },
-    });
+    g_display.width = width;
+    g_display.height = height;
+    g_display.aspect = width / (float) height;
+
+    if (g_cull.surface_id == 0) {
+        gl2__cull_reset_view();
+    }
+
+    gl2__append_command(GL2__CMD_RESIZE, &(gl2__cmd_resize) { width, height });
 }
 
 static qu_vec2i gl2_conv_cursor(qu_vec2i position)
@@ -1563,10 +6564,10 @@ static qu_vec2i gl2_conv_cursor(qu_vec2i position)
         return position;
     }
 
-    float dar = g_state.display_aspect;
+    float dar = g_display.aspect;
     float car = g_state.canvas_aspect;
-    float dw = g_state.display_width;
-    float dh = g_state.display_height;
+    float dw = g_display.width;
+    float dh = g_display.height;
     float cw = g_state.canvas_width;
     float ch = g_state.canvas_height;
 
@@ -1595,14 +6596,14 @@ static qu_vec2i gl2_conv_cursor_delta(qu_vec2i delta)
         return delta;
     }
 
-    float dar = g_state.display_aspect;
+    float dar = g_display.aspect;
     float car = g_state.canvas_aspect;
-    float dw = g_state.display_width;
-    float dh = g_state.display_height;
+    float dw = g_display.width;
+    float dh = g_display.height;
     float cw = g_state.canvas_width;
     float ch = g_state.canvas_height;
 
-    if (g_state.display_aspect > g_state.canvas_aspect) {
+    if (dar > car) {
         return (qu_vec2i) {
             .x = (delta.x * ch) / dh,
             .y = (delta.y / dh) * ch,
@@ -2,10 +2,87 @@
 //------------------------------------------------------------------------------
 
 #include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+
+//------------------------------------------------------------------------------
+// OpenGL ES extension function pointers
+
+static PFNGLMAPBUFFERRANGEEXTPROC          pf_glMapBufferRangeEXT;
+static PFNGLUNMAPBUFFEROESPROC             pf_glUnmapBufferOES;
+static PFNGLFENCESYNCAPPLEPROC             pf_glFenceSyncAPPLE;
+static PFNGLCLIENTWAITSYNCAPPLEPROC        pf_glClientWaitSyncAPPLE;
+static PFNGLDELETESYNCAPPLEPROC            pf_glDeleteSyncAPPLE;
+static PFNGLGETPROGRAMBINARYOESPROC        pf_glGetProgramBinaryOES;
+static PFNGLPROGRAMBINARYOESPROC           pf_glProgramBinaryOES;
+static PFNGLMAXSHADERCOMPILERTHREADSKHRPROC pf_glMaxShaderCompilerThreadsKHR;
+
+// Loaded from either ANGLE_instanced_arrays or EXT_instanced_arrays,
+// both have the same signatures.
+static PFNGLVERTEXATTRIBDIVISORANGLEPROC   pf_glVertexAttribDivisor;
+static PFNGLDRAWELEMENTSINSTANCEDANGLEPROC pf_glDrawElementsInstanced;
 
 //------------------------------------------------------------------------------
 // Adapter macros
 
+#ifndef GL_MAP_WRITE_BIT
+#define GL_MAP_WRITE_BIT                GL_MAP_WRITE_BIT_EXT
+#endif
+
+#ifndef GL_MAP_INVALIDATE_BUFFER_BIT
+#define GL_MAP_INVALIDATE_BUFFER_BIT    GL_MAP_INVALIDATE_BUFFER_BIT_EXT
+#endif
+
+#ifndef GL_MAP_UNSYNCHRONIZED_BIT
+#define GL_MAP_UNSYNCHRONIZED_BIT       GL_MAP_UNSYNCHRONIZED_BIT_EXT
+#endif
+
+#ifndef GL_SYNC_GPU_COMMANDS_COMPLETE
+#define GL_SYNC_GPU_COMMANDS_COMPLETE   GL_SYNC_GPU_COMMANDS_COMPLETE_APPLE
+#endif
+
+#ifndef GL_SYNC_FLUSH_COMMANDS_BIT
+#define GL_SYNC_FLUSH_COMMANDS_BIT      GL_SYNC_FLUSH_COMMANDS_BIT_APPLE
+#endif
+
+#ifndef GL_ALREADY_SIGNALED
+#define GL_ALREADY_SIGNALED             GL_ALREADY_SIGNALED_APPLE
+#endif
+
+#ifndef GL_CONDITION_SATISFIED
+#define GL_CONDITION_SATISFIED          GL_CONDITION_SATISFIED_APPLE
+#endif
+
+#ifndef GL_PIXEL_UNPACK_BUFFER
+#define GL_PIXEL_UNPACK_BUFFER          GL_PIXEL_UNPACK_BUFFER_NV
+#endif
+
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH        GL_PROGRAM_BINARY_LENGTH_OES
+#endif
+
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS   GL_NUM_PROGRAM_BINARY_FORMATS_OES
+#endif
+
+// OES_get_program_binary has no retrievable hint, binaries are always
+// available.
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+
+#define glProgramParameteri(program, pname, value)
+
+#define glMapBufferRange                pf_glMapBufferRangeEXT
+#define glUnmapBuffer                   pf_glUnmapBufferOES
+#define glFenceSync                     pf_glFenceSyncAPPLE
+#define glClientWaitSync                pf_glClientWaitSyncAPPLE
+#define glDeleteSync                    pf_glDeleteSyncAPPLE
+#define glGetProgramBinary              pf_glGetProgramBinaryOES
+#define glProgramBinary                 pf_glProgramBinaryOES
+#define glMaxShaderCompilerThreads      pf_glMaxShaderCompilerThreadsKHR
+#define glVertexAttribDivisor           pf_glVertexAttribDivisor
+#define glDrawElementsInstanced         pf_glDrawElementsInstanced
+
 #define GL2_SHADER_VERTEX_SRC \
     "attribute vec2 a_position;\n" \
     "attribute vec4 a_color;\n" \
@@ -24,44 +101,158 @@
 
 #define GL2_SHADER_SOLID_SRC \
     "precision mediump float;\n" \
+    "varying vec4 v_color;\n" \
     "uniform vec4 u_color;\n" \
     "void main()\n" \
     "{\n" \
-    "    gl_FragColor = u_color;\n" \
+    "    gl_FragColor = v_color * u_color;\n" \
     "}\n"
 
 #define GL2_SHADER_TEXTURED_SRC \
     "precision mediump float;\n" \
+    "varying vec4 v_color;\n" \
     "varying vec2 v_texCoord;\n" \
     "uniform sampler2D u_texture;\n" \
     "uniform vec4 u_color;\n" \
     "void main()\n" \
     "{\n" \
-    "    gl_FragColor = texture2D(u_texture, v_texCoord) * u_color;\n" \
+    "    gl_FragColor = texture2D(u_texture, v_texCoord) * v_color * u_color;\n" \
     "}\n"
 
 #define GL2_SHADER_CANVAS_SRC \
     "attribute vec2 a_position;\n" \
+    "attribute vec4 a_color;\n" \
     "attribute vec2 a_texCoord;\n" \
+    "varying vec4 v_color;\n" \
     "varying vec2 v_texCoord;\n" \
     "uniform mat4 u_projection;\n" \
     "void main()\n" \
     "{\n" \
     "    v_texCoord = a_texCoord;\n" \
+    "    v_color = a_color;\n" \
     "    vec4 position = vec4(a_position, 0.0, 1.0);\n" \
     "    gl_Position = u_projection * position;\n" \
     "}\n"
 
+#define GL2_SHADER_SPRITE_SRC \
+    "attribute vec2 a_position;\n" \
+    "attribute vec4 a_color;\n" \
+    "attribute vec4 a_spriteRect;\n" \
+    "attribute vec4 a_spriteUV;\n" \
+    "attribute float a_spriteRotation;\n" \
+    "varying vec4 v_color;\n" \
+    "varying vec2 v_texCoord;\n" \
+    "uniform mat4 u_projection;\n" \
+    "uniform mat4 u_modelView;\n" \
+    "void main()\n" \
+    "{\n" \
+    "    vec2 corner = (a_position - 0.5) * a_spriteRect.zw;\n" \
+    "    float c = cos(a_spriteRotation);\n" \
+    "    float s = sin(a_spriteRotation);\n" \
+    "    vec2 offset = vec2(corner.x * c - corner.y * s, corner.x * s + corner.y * c);\n" \
+    "    v_texCoord = mix(a_spriteUV.xy, a_spriteUV.zw, a_position);\n" \
+    "    v_color = a_color;\n" \
+    "    vec4 position = vec4(a_spriteRect.xy + offset, 0.0, 1.0);\n" \
+    "    gl_Position = u_projection * u_modelView * position;\n" \
+    "}\n"
+
+#define GL2_SHADER_CIRCLE_VERTEX_SRC \
+    "attribute vec2 a_position;\n" \
+    "attribute vec4 a_color;\n" \
+    "attribute vec4 a_outlineColor;\n" \
+    "attribute vec4 a_circle;\n" \
+    "varying vec4 v_color;\n" \
+    "varying vec4 v_outlineColor;\n" \
+    "varying vec4 v_circle;\n" \
+    "uniform mat4 u_projection;\n" \
+    "uniform mat4 u_modelView;\n" \
+    "void main()\n" \
+    "{\n" \
+    "    v_color = a_color;\n" \
+    "    v_outlineColor = a_outlineColor;\n" \
+    "    v_circle = a_circle;\n" \
+    "    vec4 position = vec4(a_position, 0.0, 1.0);\n" \
+    "    gl_Position = u_projection * u_modelView * position;\n" \
+    "}\n"
+
+#define GL2_SHADER_CIRCLE_SRC \
+    "#ifdef GL_FRAGMENT_PRECISION_HIGH\n" \
+    "precision highp float;\n" \
+    "#else\n" \
+    "precision mediump float;\n" \
+    "#endif\n" \
+    "varying vec4 v_color;\n" \
+    "varying vec4 v_outlineColor;\n" \
+    "varying vec4 v_circle;\n" \
+    "uniform vec4 u_color;\n" \
+    "void main()\n" \
+    "{\n" \
+    "    float d = length(v_circle.xy);\n" \
+    "    float w = v_circle.w * 0.5;\n" \
+    "    float coverage = clamp(v_circle.z + w - d + 0.5, 0.0, 1.0);\n" \
+    "    float inner = clamp(v_circle.z - w - d + 0.5, 0.0, 1.0);\n" \
+    "    vec4 color = mix(v_outlineColor, v_color, inner);\n" \
+    "    gl_FragColor = vec4(color.rgb, color.a * coverage) * u_color;\n" \
+    "}\n"
+
 //------------------------------------------------------------------------------
 // Shared implementation
 
 #include "qu_graphics_gl2_impl.h"
 
+//------------------------------------------------------------------------------
+// Extension loader
+
+static void load_glext(char const *extension)
+{
+    if (strcmp(extension, "GL_EXT_map_buffer_range") == 0) {
+        pf_glMapBufferRangeEXT = libqu_gl_proc_address("glMapBufferRangeEXT");
+    } else if (strcmp(extension, "GL_OES_mapbuffer") == 0) {
+        pf_glUnmapBufferOES = libqu_gl_proc_address("glUnmapBufferOES");
+    } else if (strcmp(extension, "GL_APPLE_sync") == 0) {
+        pf_glFenceSyncAPPLE = libqu_gl_proc_address("glFenceSyncAPPLE");
+        pf_glClientWaitSyncAPPLE = libqu_gl_proc_address("glClientWaitSyncAPPLE");
+        pf_glDeleteSyncAPPLE = libqu_gl_proc_address("glDeleteSyncAPPLE");
+    } else if (strcmp(extension, "GL_ANGLE_instanced_arrays") == 0) {
+        pf_glVertexAttribDivisor = libqu_gl_proc_address("glVertexAttribDivisorANGLE");
+        pf_glDrawElementsInstanced = libqu_gl_proc_address("glDrawElementsInstancedANGLE");
+    } else if (strcmp(extension, "GL_EXT_instanced_arrays") == 0 && !pf_glVertexAttribDivisor) {
+        pf_glVertexAttribDivisor = libqu_gl_proc_address("glVertexAttribDivisorEXT");
+        pf_glDrawElementsInstanced = libqu_gl_proc_address("glDrawElementsInstancedEXT");
+    } else if (strcmp(extension, "GL_NV_pixel_buffer_object") == 0) {
+        g_caps.pixel_buffer = true;
+    } else if (strcmp(extension, "GL_OES_texture_npot") == 0) {
+        g_caps.npot_mipmaps = true;
+    } else if (strcmp(extension, "GL_EXT_texture_compression_s3tc") == 0
+               || strcmp(extension, "GL_WEBGL_compressed_texture_s3tc") == 0) {
+        g_caps.texture_s3tc = true;
+    } else if (strcmp(extension, "GL_OES_compressed_ETC1_RGB8_texture") == 0
+               || strcmp(extension, "GL_WEBGL_compressed_texture_etc1") == 0) {
+        g_caps.texture_etc1 = true;
+    } else if (strcmp(extension, "GL_WEBGL_compressed_texture_etc") == 0) {
+        g_caps.texture_etc2 = true;
+    } else if (strcmp(extension, "GL_OES_get_program_binary") == 0) {
+        pf_glGetProgramBinaryOES = libqu_gl_proc_address("glGetProgramBinaryOES");
+        pf_glProgramBinaryOES = libqu_gl_proc_address("glProgramBinaryOES");
+    } else if (strcmp(extension, "GL_KHR_parallel_shader_compile") == 0) {
+        pf_glMaxShaderCompilerThreadsKHR = libqu_gl_proc_address("glMaxShaderCompilerThreadsKHR");
+    }
+}
+
 //------------------------------------------------------------------------------
 // Initializer
 
 static void initialize(qu_params const *params)
 {
+    gl2__load_extensions(load_glext);
+
+    g_caps.map_buffer_range = pf_glMapBufferRangeEXT && pf_glUnmapBufferOES;
+    g_caps.sync = pf_glFenceSyncAPPLE && pf_glClientWaitSyncAPPLE && pf_glDeleteSyncAPPLE;
+    g_caps.instanced_arrays = pf_glVertexAttribDivisor && pf_glDrawElementsInstanced;
+    g_caps.generate_mipmap = true;
+    g_caps.program_binary = pf_glGetProgramBinaryOES && pf_glProgramBinaryOES;
+    g_caps.parallel_compile = (pf_glMaxShaderCompilerThreadsKHR != NULL);
+
     gl2_initialize(params);
 }
 
@@ -90,6 +281,8 @@ void libqu_construct_gles2_graphics(libqu_graphics *graphics)
         .translate = gl2_translate,
         .scale = gl2_scale,
         .rotate = gl2_rotate,
+        .set_layer = gl2_set_layer,
+        .set_outline_width = gl2_set_outline_width,
         .clear = gl2_clear,
         .draw_point = gl2_draw_point,
         .draw_line = gl2_draw_line,
@@ -99,15 +292,35 @@ void libqu_construct_gles2_graphics(libqu_graphics *graphics)
         .create_texture = gl2_create_texture,
         .update_texture = gl2_update_texture,
         .load_texture = gl2_load_texture,
+        .load_texture_async = gl2_load_texture_async,
+        .is_texture_ready = gl2_is_texture_ready,
         .delete_texture = gl2_delete_texture,
         .set_texture_smooth = gl2_set_texture_smooth,
+        .set_texture_filter = gl2_set_texture_filter,
         .draw_texture = gl2_draw_texture,
         .draw_subtexture = gl2_draw_subtexture,
+        .draw_sprites = gl2_draw_sprites,
+        .draw_particles = gl2_draw_particles,
         .draw_text = gl2_draw_text,
         .create_surface = gl2_create_surface,
         .delete_surface = gl2_delete_surface,
+        .resize_surface = gl2_resize_surface,
         .set_surface = gl2_set_surface,
         .reset_surface = gl2_reset_surface,
         .draw_surface = gl2_draw_surface,
+        .create_command_list = gl2_create_command_list,
+        .delete_command_list = gl2_delete_command_list,
+        .begin_command_list = gl2_begin_command_list,
+        .end_command_list = gl2_end_command_list,
+        .draw_command_list = gl2_draw_command_list,
+        .create_tilemap = gl2_create_tilemap,
+        .delete_tilemap = gl2_delete_tilemap,
+        .set_tile = gl2_set_tile,
+        .draw_tilemap = gl2_draw_tilemap,
+        .begin_mesh = gl2_begin_mesh,
+        .end_mesh = gl2_end_mesh,
+        .delete_mesh = gl2_delete_mesh,
+        .draw_mesh = gl2_draw_mesh,
+        .get_render_stats = gl2_get_render_stats,
     };
 }
@@ -23,6 +23,7 @@ static bool is_initialized(void)
 
 static void swap(void)
 {
+    libqu_gl_swap_buffers();
 }
 
 static void notify_display_resize(int width, int height)
@@ -51,6 +52,14 @@ static void rotate(float degrees)
 {
 }
 
+static void set_layer(int layer)
+{
+}
+
+static void set_outline_width(float width)
+{
+}
+
 static void clear(qu_color clear_color)
 {
 }
@@ -91,6 +100,16 @@ static int32_t load_texture(libqu_file *file)
     return 1;
 }
 
+static int32_t load_texture_async(libqu_file *file)
+{
+    return 1;
+}
+
+static bool is_texture_ready(int32_t texture_id)
+{
+    return true;
+}
+
 static void delete_texture(int32_t texture_id)
 {
 }
@@ -99,6 +118,10 @@ static void set_texture_smooth(int32_t texture_id, bool smooth)
 {
 }
 
+static void set_texture_filter(int32_t texture_id, qu_texture_filter filter)
+{
+}
+
 static void draw_texture(int32_t texture_id, float x, float y, float w, float h)
 {
 }
@@ -107,12 +130,89 @@ static void draw_subtexture(int32_t texture_id, float x, float y, float w, float
 {
 }
 
+static void draw_sprites(int32_t texture_id, qu_sprite const *sprites, int count)
+{
+}
+
+static void draw_particles(int32_t texture_id, float const *x, float const *y, float const *size, qu_color const *color, int count)
+{
+}
+
 static void draw_text(int32_t texture_id, qu_color color, float const *data, int count)
 {
 }
 
 //------------------------------------------------------------------------------
 
+static int32_t create_command_list(void)
+{
+    return 1;
+}
+
+static void delete_command_list(int32_t id)
+{
+}
+
+static void begin_command_list(int32_t id)
+{
+}
+
+static void end_command_list(void)
+{
+}
+
+static void draw_command_list(int32_t id)
+{
+}
+
+//------------------------------------------------------------------------------
+
+static int32_t create_tilemap(int32_t texture_id, int tile_width, int tile_height,
+                              int columns, int rows, int const *tiles)
+{
+    return 1;
+}
+
+static void delete_tilemap(int32_t id)
+{
+}
+
+static void set_tile(int32_t id, int column, int row, int tile)
+{
+}
+
+static void draw_tilemap(int32_t id, float x, float y)
+{
+}
+
+//------------------------------------------------------------------------------
+
+static void begin_mesh(void)
+{
+}
+
+static int32_t end_mesh(void)
+{
+    return 1;
+}
+
+static void delete_mesh(int32_t id)
+{
+}
+
+static void draw_mesh(int32_t id, float x, float y)
+{
+}
+
+//------------------------------------------------------------------------------
+
+static qu_render_stats get_render_stats(void)
+{
+    return (qu_render_stats) { 0 };
+}
+
+//------------------------------------------------------------------------------
+
 void libqu_construct_null_graphics(libqu_graphics *graphics)
 {
     *graphics = (libqu_graphics) {
@@ -126,6 +226,8 @@ void libqu_construct_null_graphics(libqu_graphics *graphics)
         .translate = translate,
         .scale = scale,
         .rotate = rotate,
+        .set_layer = set_layer,
+        .set_outline_width = set_outline_width,
         .clear = clear,
         .draw_point = draw_point,
         .draw_line = draw_line,
@@ -135,11 +237,30 @@ void libqu_construct_null_graphics(libqu_graphics *graphics)
         .create_texture = create_texture,
         .update_texture = update_texture,
         .load_texture = load_texture,
+        .load_texture_async = load_texture_async,
+        .is_texture_ready = is_texture_ready,
         .delete_texture = delete_texture,
         .set_texture_smooth = set_texture_smooth,
+        .set_texture_filter = set_texture_filter,
         .draw_texture = draw_texture,
         .draw_subtexture = draw_subtexture,
+        .draw_sprites = draw_sprites,
+        .draw_particles = draw_particles,
         .draw_text = draw_text,
+        .create_command_list = create_command_list,
+        .delete_command_list = delete_command_list,
+        .begin_command_list = begin_command_list,
+        .end_command_list = end_command_list,
+        .draw_command_list = draw_command_list,
+        .create_tilemap = create_tilemap,
+        .delete_tilemap = delete_tilemap,
+        .set_tile = set_tile,
+        .draw_tilemap = draw_tilemap,
+        .begin_mesh = begin_mesh,
+        .end_mesh = end_mesh,
+        .delete_mesh = delete_mesh,
+        .draw_mesh = draw_mesh,
+        .get_render_stats = get_render_stats,
     };
 }
 
@@ -30,11 +30,197 @@ static int eof(void *user)
     return (position == size);
 }
 
+//------------------------------------------------------------------------------
+// KTX container
+
+static unsigned char const ktx_identifier[12] = {
+    0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n',
+};
+
+struct ktx_header
+{
+    uint32_t endianness;
+    uint32_t gl_type;
+    uint32_t gl_type_size;
+    uint32_t gl_format;
+    uint32_t gl_internal_format;
+    uint32_t gl_base_internal_format;
+    uint32_t pixel_width;
+    uint32_t pixel_height;
+    uint32_t pixel_depth;
+    uint32_t number_of_array_elements;
+    uint32_t number_of_faces;
+    uint32_t number_of_mipmap_levels;
+    uint32_t bytes_of_key_value_data;
+};
+
+static uint32_t swap_u32(uint32_t x)
+{
+    return ((x & 0x000000FF) << 24) | ((x & 0x0000FF00) << 8)
+        | ((x & 0x00FF0000) >> 8) | ((x & 0xFF000000) >> 24);
+}
+
+/**
+ * Map glInternalFormat of a KTX file to compression, also returning
+ * size of a 4x4 block in bytes.
+ */
+static libqu_compression get_ktx_compression(uint32_t format, int *block_size)
+{
+    *block_size = 8;
+
+    switch (format) {
+    case 0x83F0:    // GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+        return LIBQU_COMPRESSION_DXT1;
+    case 0x83F1:    // GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+        return LIBQU_COMPRESSION_DXT1A;
+    case 0x8D64:    // GL_ETC1_RGB8_OES
+        return LIBQU_COMPRESSION_ETC1;
+    case 0x9274:    // GL_COMPRESSED_RGB8_ETC2
+        return LIBQU_COMPRESSION_ETC2;
+    }
+
+    *block_size = 16;
+
+    switch (format) {
+    case 0x83F2:    // GL_COMPRESSED_RGBA_S3TC_DXT3_EXT
+        return LIBQU_COMPRESSION_DXT3;
+    case 0x83F3:    // GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+        return LIBQU_COMPRESSION_DXT5;
+    case 0x9278:    // GL_COMPRESSED_RGBA8_ETC2_EAC
+        return LIBQU_COMPRESSION_ETC2_EAC;
+    }
+
+    return LIBQU_COMPRESSION_NONE;
+}
+
+static libqu_image *load_ktx(libqu_file *file)
+{
+    struct ktx_header header;
+
+    if (libqu_fread(&header, sizeof(header), file) < (int64_t) sizeof(header)) {
+        return NULL;
+    }
+
+    bool swap = (header.endianness == 0x01020304);
+
+    if (swap) {
+        uint32_t *fields = (uint32_t *) &header;
+
+        for (size_t i = 0; i < sizeof(header) / sizeof(uint32_t); i++) {
+            fields[i] = swap_u32(fields[i]);
+        }
+    }
+
+    int block_size;
+    libqu_compression compression = get_ktx_compression(header.gl_internal_format, &block_size);
+
+    if (header.gl_type != 0 || compression == LIBQU_COMPRESSION_NONE) {
+        libqu_error("KTX file %s is not in a supported compressed format (0x%04x).\n",
+            libqu_file_repr(file), header.gl_internal_format);
+        return NULL;
+    }
+
+    if (header.pixel_depth > 1 || header.number_of_array_elements > 0
+        || header.number_of_faces != 1) {
+        libqu_error("KTX file %s is not a 2D texture.\n", libqu_file_repr(file));
+        return NULL;
+    }
+
+    if (header.pixel_width == 0 || header.pixel_height == 0
+        || header.pixel_width > 32768 || header.pixel_height > 32768) {
+        return NULL;
+    }
+
+    int level_count = QU_MAX(1, (int) header.number_of_mipmap_levels);
+    level_count = QU_MIN(level_count, LIBQU_MAX_IMAGE_LEVELS);
+
+    libqu_image *image = calloc(1, sizeof(libqu_image));
+
+    if (!image) {
+        return NULL;
+    }
+
+    image->width = header.pixel_width;
+    image->height = header.pixel_height;
+    image->compression = compression;
+    image->level_count = level_count;
+
+    // Total size of all levels, as expected from dimensions
+    size_t total_size = 0;
+
+    for (int i = 0; i < level_count; i++) {
+        size_t w = QU_MAX(1, image->width >> i);
+        size_t h = QU_MAX(1, image->height >> i);
+
+        image->level_sizes[i] = ((w + 3) / 4) * ((h + 3) / 4) * block_size;
+        total_size += image->level_sizes[i];
+    }
+
+    image->pixels = malloc(total_size);
+
+    if (!image->pixels) {
+        free(image);
+        return NULL;
+    }
+
+    libqu_fseek(file, header.bytes_of_key_value_data, SEEK_CUR);
+
+    unsigned char *level = image->pixels;
+
+    for (int i = 0; i < level_count; i++) {
+        uint32_t size;
+
+        if (libqu_fread(&size, sizeof(size), file) < (int64_t) sizeof(size)) {
+            break;
+        }
+
+        if (swap) {
+            size = swap_u32(size);
+        }
+
+        if (size != image->level_sizes[i]) {
+            break;
+        }
+
+        if (libqu_fread(level, size, file) < (int64_t) size) {
+            break;
+        }
+
+        // Block sizes are multiples of 4, so there is no padding.
+        level += size;
+        image->level_count = i + 1;
+    }
+
+    if (level == image->pixels) {
+        libqu_error("Failed to read compressed image from %s.\n", libqu_file_repr(file));
+
+        free(image->pixels);
+        free(image);
+        return NULL;
+    }
+
+    libqu_info("Loaded %dx%d compressed image (%d levels) from %s.\n",
+        image->width, image->height, image->level_count, libqu_file_repr(file));
+
+    return image;
+}
+
+//------------------------------------------------------------------------------
+
 libqu_image *libqu_load_image(libqu_file *file)
 {
     // stbi_set_flip_vertically_on_load(1);
 
-    libqu_image *image = malloc(sizeof(libqu_image));
+    unsigned char identifier[sizeof(ktx_identifier)];
+
+    if (libqu_fread(identifier, sizeof(identifier), file) == sizeof(identifier)
+        && memcmp(identifier, ktx_identifier, sizeof(identifier)) == 0) {
+        return load_ktx(file);
+    }
+
+    libqu_fseek(file, 0, SEEK_SET);
+
+    libqu_image *image = calloc(1, sizeof(libqu_image));
 
     if (!image) {
         return NULL;
@@ -59,6 +245,9 @@ libqu_image *libqu_load_image(libqu_file *file)
         return NULL;
     }
 
+    image->level_count = 1;
+    image->level_sizes[0] = (size_t) image->width * image->height * image->channels;
+
     libqu_info("Loaded %dx%dx%d image from %s.\n",
         image->width, image->height,
         image->channels, libqu_file_repr(file));
@@ -68,8 +257,252 @@ libqu_image *libqu_load_image(libqu_file *file)
 
 void libqu_delete_image(libqu_image *image)
 {
-    stbi_image_free(image->pixels);
+    if (image->compression == LIBQU_COMPRESSION_NONE) {
+        stbi_image_free(image->pixels);
+    } else {
+        free(image->pixels);
+    }
+
     free(image);
 }
 
 //------------------------------------------------------------------------------
+// Asynchronous loading
+
+#define MAX_LOADER_THREADS          (8)
+
+enum
+{
+    JOB_QUEUED,
+    JOB_RUNNING,
+    JOB_DONE,
+};
+
+struct libqu_image_job
+{
+    libqu_file *file;
+    libqu_image *image;
+    int state;
+    bool cancelled;
+    libqu_image_job *next;
+};
+
+static struct
+{
+    libqu_mutex *mutex;
+    libqu_cond *cond;
+    libqu_thread *threads[MAX_LOADER_THREADS];
+    int thread_count;
+    libqu_image_job *head;
+    libqu_image_job *tail;
+    bool quit;
+} loader;
+
+static intptr_t loader_main(void *arg)
+{
+    libqu_lock_mutex(loader.mutex);
+
+    while (true) {
+        while (!loader.head && !loader.quit) {
+            libqu_wait_cond(loader.cond, loader.mutex);
+        }
+
+        if (loader.quit) {
+            break;
+        }
+
+        libqu_image_job *job = loader.head;
+
+        loader.head = job->next;
+
+        if (!loader.head) {
+            loader.tail = NULL;
+        }
+
+        job->state = JOB_RUNNING;
+
+        libqu_unlock_mutex(loader.mutex);
+
+        libqu_image *image = libqu_load_image(job->file);
+        libqu_fclose(job->file);
+
+        libqu_lock_mutex(loader.mutex);
+
+        if (job->cancelled) {
+            if (image) {
+                libqu_delete_image(image);
+            }
+
+            free(job);
+        } else {
+            job->image = image;
+            job->state = JOB_DONE;
+        }
+    }
+
+    libqu_unlock_mutex(loader.mutex);
+
+    return 0;
+}
+
+static bool start_loader(void)
+{
+    loader.mutex = libqu_create_mutex();
+    loader.cond = libqu_create_cond();
+
+    if (!loader.mutex || !loader.cond) {
+        libqu_destroy_cond(loader.cond);
+        libqu_destroy_mutex(loader.mutex);
+        return false;
+    }
+
+    // Leave one core to the main thread.
+    int count = QU_MAX(1, QU_MIN(libqu_get_cpu_count() - 1, MAX_LOADER_THREADS));
+
+    for (int i = 0; i < count; i++) {
+        libqu_thread *thread = libqu_create_thread("image loader", loader_main, NULL);
+
+        if (!thread) {
+            break;
+        }
+
+        loader.threads[loader.thread_count++] = thread;
+    }
+
+    if (loader.thread_count == 0) {
+        libqu_destroy_cond(loader.cond);
+        libqu_destroy_mutex(loader.mutex);
+        return false;
+    }
+
+    libqu_info("Started %d image loader threads.\n", loader.thread_count);
+
+    return true;
+}
+
+/**
+ * Queue decoding of an image on a worker thread, which takes ownership
+ * of the file. Returns NULL if the job can't be queued, in which case
+ * the file is left to the caller.
+ */
+libqu_image_job *libqu_load_image_async(libqu_file *file)
+{
+    if (!loader.thread_count && !start_loader()) {
+        return NULL;
+    }
+
+    libqu_image_job *job = calloc(1, sizeof(libqu_image_job));
+
+    if (!job) {
+        return NULL;
+    }
+
+    job->file = file;
+    job->state = JOB_QUEUED;
+
+    libqu_lock_mutex(loader.mutex);
+
+    if (loader.tail) {
+        loader.tail->next = job;
+    } else {
+        loader.head = job;
+    }
+
+    loader.tail = job;
+
+    libqu_signal_cond(loader.cond);
+    libqu_unlock_mutex(loader.mutex);
+
+    return job;
+}
+
+/**
+ * Check if the job is finished. If it is, the decoded image (or NULL if
+ * decoding failed) is written to `image` and the job is released.
+ */
+bool libqu_poll_image_job(libqu_image_job *job, libqu_image **image)
+{
+    libqu_lock_mutex(loader.mutex);
+    bool done = (job->state == JOB_DONE);
+    libqu_unlock_mutex(loader.mutex);
+
+    if (!done) {
+        return false;
+    }
+
+    *image = job->image;
+    free(job);
+
+    return true;
+}
+
+/**
+ * Release the job without waiting for it.
+ */
+void libqu_cancel_image_job(libqu_image_job *job)
+{
+    libqu_lock_mutex(loader.mutex);
+
+    if (job->state == JOB_RUNNING) {
+        // Worker thread will release it.
+        job->cancelled = true;
+        libqu_unlock_mutex(loader.mutex);
+        return;
+    }
+
+    if (job->state == JOB_QUEUED) {
+        libqu_image_job **link = &loader.head;
+        libqu_image_job *prev = NULL;
+
+        while (*link != job) {
+            prev = *link;
+            link = &(*link)->next;
+        }
+
+        *link = job->next;
+
+        if (loader.tail == job) {
+            loader.tail = prev;
+        }
+
+        libqu_fclose(job->file);
+    } else if (job->image) {
+        libqu_delete_image(job->image);
+    }
+
+    libqu_unlock_mutex(loader.mutex);
+
+    free(job);
+}
+
+void libqu_terminate_image_loader(void)
+{
+    if (!loader.thread_count) {
+        return;
+    }
+
+    libqu_lock_mutex(loader.mutex);
+    loader.quit = true;
+    libqu_signal_cond(loader.cond);
+    libqu_unlock_mutex(loader.mutex);
+
+    for (int i = 0; i < loader.thread_count; i++) {
+        libqu_wait_thread(loader.threads[i]);
+    }
+
+    // Jobs which weren't picked up
+    while (loader.head) {
+        libqu_image_job *job = loader.head;
+        loader.head = job->next;
+
+        libqu_fclose(job->file);
+        free(job);
+    }
+
+    libqu_destroy_cond(loader.cond);
+    libqu_destroy_mutex(loader.mutex);
+
+    memset(&loader, 0, sizeof(loader));
+}
+
+//------------------------------------------------------------------------------
@@ -0,0 +1,268 @@
+//------------------------------------------------------------------------------
+// !START!
+//------------------------------------------------------------------------------
+
+#include "qu.h"
+
+//------------------------------------------------------------------------------
+
+// Number of particles is rounded up to a multiple of this,
+// so that every attribute array starts on a 16-byte boundary.
+#define CAPACITY_GRANULARITY        4
+
+//------------------------------------------------------------------------------
+
+/**
+ * Particles are stored as a structure of arrays: the update kernel
+ * streams through each attribute separately, which lets the compiler
+ * vectorize it, and the renderer reads only what it needs.
+ */
+struct particle_system
+{
+    int32_t texture_id;             // 0 to draw untextured squares
+    int capacity;                   // max number of live particles
+    int count;                      // number of live particles
+    float gravity_x;                // acceleration applied to velocity
+    float gravity_y;
+
+    void *block;                    // single allocation holding all arrays
+    float *x;                       // position of the center
+    float *y;
+    float *dx;                      // velocity
+    float *dy;
+    float *life;                    // remaining lifetime
+    float *size;                    // width and height
+    float *growth;                  // change of size per unit of time
+    qu_color *color;
+};
+
+static struct
+{
+    bool initialized;
+    libqu_graphics *graphics;       // pointer to renderer
+    libqu_array *systems;           // array of particle systems
+} impl;
+
+//------------------------------------------------------------------------------
+
+static void particle_system_dtor(void *data)
+{
+    struct particle_system *system = data;
+
+    free(system->block);
+}
+
+static struct particle_system *get_system(int32_t id)
+{
+    if (!impl.initialized) {
+        return NULL;
+    }
+
+    return libqu_array_get(impl.systems, id);
+}
+
+/**
+ * Advance all particles by `dt`.
+ */
+static void integrate(int count, float dt, float gx, float gy,
+                      float *restrict x, float *restrict y,
+                      float *restrict dx, float *restrict dy,
+                      float *restrict life, float *restrict size,
+                      float const *restrict growth)
+{
+    for (int i = 0; i < count; i++) {
+        dx[i] += gx * dt;
+        dy[i] += gy * dt;
+        x[i] += dx[i] * dt;
+        y[i] += dy[i] * dt;
+        life[i] -= dt;
+        size[i] += growth[i] * dt;
+    }
+}
+
+/**
+ * Remove expired particles, keeping the order of the rest.
+ * Returns the number of live particles.
+ */
+static int compact(struct particle_system *system)
+{
+    int live = 0;
+
+    for (int i = 0; i < system->count; i++) {
+        if (system->life[i] <= 0.f || system->size[i] <= 0.f) {
+            continue;
+        }
+
+        if (live != i) {
+            system->x[live] = system->x[i];
+            system->y[live] = system->y[i];
+            system->dx[live] = system->dx[i];
+            system->dy[live] = system->dy[i];
+            system->life[live] = system->life[i];
+            system->size[live] = system->size[i];
+            system->growth[live] = system->growth[i];
+            system->color[live] = system->color[i];
+        }
+
+        live++;
+    }
+
+    return live;
+}
+
+//------------------------------------------------------------------------------
+
+/**
+ * Initialize particle module.
+ */
+void libqu_initialize_particles(libqu_graphics *graphics)
+{
+    memset(&impl, 0, sizeof(impl));
+
+    impl.graphics = graphics;
+    impl.systems = libqu_create_array(sizeof(struct particle_system),
+                                      particle_system_dtor);
+
+    if (!impl.systems) {
+        libqu_error("Failed to initialize particle module.\n");
+        return;
+    }
+
+    impl.initialized = true;
+}
+
+/**
+ * Terminate particle module.
+ */
+void libqu_terminate_particles(void)
+{
+    libqu_destroy_array(impl.systems);
+    impl.systems = NULL;
+    impl.initialized = false;
+}
+
+/**
+ * Create a particle system for up to `capacity` live particles.
+ */
+int32_t libqu_create_particle_system(int32_t texture_id, int capacity)
+{
+    if (!impl.initialized || capacity <= 0) {
+        return 0;
+    }
+
+    int n = (capacity + CAPACITY_GRANULARITY - 1) & ~(CAPACITY_GRANULARITY - 1);
+
+    // Colors go first, as they have the strictest alignment.
+    void *block = malloc((sizeof(qu_color) + sizeof(float) * 7) * n);
+
+    if (!block) {
+        libqu_error("Failed to allocate %d particles.\n", capacity);
+        return 0;
+    }
+
+    float *attributes = (float *) ((qu_color *) block + n);
+
+    struct particle_system system = {
+        .texture_id = texture_id,
+        .capacity = capacity,
+        .block = block,
+        .x = attributes,
+        .y = attributes + n,
+        .dx = attributes + n * 2,
+        .dy = attributes + n * 3,
+        .life = attributes + n * 4,
+        .size = attributes + n * 5,
+        .growth = attributes + n * 6,
+        .color = block,
+    };
+
+    return libqu_array_add(impl.systems, &system);
+}
+
+void libqu_delete_particle_system(int32_t id)
+{
+    if (!impl.initialized) {
+        return;
+    }
+
+    libqu_array_remove(impl.systems, id);
+}
+
+void libqu_set_particle_gravity(int32_t id, float x, float y)
+{
+    struct particle_system *system = get_system(id);
+
+    if (!system) {
+        return;
+    }
+
+    system->gravity_x = x;
+    system->gravity_y = y;
+}
+
+/**
+ * Add particles to the system. Particles that don't fit are dropped.
+ */
+void libqu_emit_particles(int32_t id, qu_particle const *particles, int count)
+{
+    struct particle_system *system = get_system(id);
+
+    if (!system || !particles) {
+        return;
+    }
+
+    count = QU_MIN(count, system->capacity - system->count);
+
+    for (int i = 0; i < count; i++) {
+        int k = system->count + i;
+
+        system->x[k] = particles[i].x;
+        system->y[k] = particles[i].y;
+        system->dx[k] = particles[i].dx;
+        system->dy[k] = particles[i].dy;
+        system->life[k] = particles[i].life;
+        system->size[k] = particles[i].size;
+        system->growth[k] = particles[i].growth;
+        system->color[k] = particles[i].color;
+    }
+
+    system->count += QU_MAX(count, 0);
+}
+
+void libqu_update_particle_system(int32_t id, float dt)
+{
+    struct particle_system *system = get_system(id);
+
+    if (!system) {
+        return;
+    }
+
+    integrate(system->count, dt, system->gravity_x, system->gravity_y,
+              system->x, system->y, system->dx, system->dy,
+              system->life, system->size, system->growth);
+
+    system->count = compact(system);
+}
+
+int libqu_get_particle_count(int32_t id)
+{
+    struct particle_system *system = get_system(id);
+
+    if (!system) {
+        return 0;
+    }
+
+    return system->count;
+}
+
+void libqu_draw_particle_system(int32_t id)
+{
+    struct particle_system *system = get_system(id);
+
+    if (!system || system->count == 0) {
+        return;
+    }
+
+    impl.graphics->draw_particles(system->texture_id, system->x, system->y,
+                                  system->size, system->color, system->count);
+}
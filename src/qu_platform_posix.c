@@ -7,6 +7,7 @@
 
 #include <errno.h>
 #include <pthread.h>
+#include <unistd.h>
 
 #include "qu.h"
 
@@ -19,9 +20,12 @@
 struct libqu_thread
 {
     pthread_t id;
+    pthread_mutex_t lock;
     char name[THREAD_NAME_LENGTH];
     intptr_t(*func)(void *arg);
     void *arg;
+    bool detached;
+    bool finished;
 };
 
 struct libqu_mutex
@@ -29,6 +33,11 @@ struct libqu_mutex
     pthread_mutex_t id;
 };
 
+struct libqu_cond
+{
+    pthread_cond_t id;
+};
+
 //------------------------------------------------------------------------------
 
 static uint64_t start_mediump;
@@ -74,11 +83,27 @@ double libqu_get_time_highp(void)
 //------------------------------------------------------------------------------
 // Threads
 
+static void free_thread(libqu_thread *thread)
+{
+    pthread_mutex_destroy(&thread->lock);
+    free(thread);
+}
+
 static void *thread_main(void *thread_ptr)
 {
     libqu_thread *thread = thread_ptr;
     intptr_t retval = thread->func(thread->arg);
-    free(thread);
+
+    // Info struct of a joinable thread is released in libqu_wait_thread(),
+    // detached thread should release it by itself.
+    pthread_mutex_lock(&thread->lock);
+    bool detached = thread->detached;
+    thread->finished = true;
+    pthread_mutex_unlock(&thread->lock);
+
+    if (detached) {
+        free_thread(thread);
+    }
 
     return (void *) retval;
 }
@@ -101,11 +126,13 @@ libqu_thread *libqu_create_thread(char const *name, intptr_t(*func)(void *), voi
     thread->func = func;
     thread->arg = arg;
 
+    pthread_mutex_init(&thread->lock, NULL);
+
     int error = pthread_create(&thread->id, NULL, thread_main, thread);
 
     if (error) {
         libqu_error("Error (code %d) occured while attempting to create thread \'%s\'.\n", error, thread->name);
-        free(thread);
+        free_thread(thread);
 
         return NULL;
     }
@@ -124,6 +151,15 @@ void libqu_detach_thread(libqu_thread *thread)
     if (error) {
         libqu_error("Failed to detach thread \'%s\', error code: %d.\n", thread->name, error);
     }
+
+    pthread_mutex_lock(&thread->lock);
+    bool finished = thread->finished;
+    thread->detached = true;
+    pthread_mutex_unlock(&thread->lock);
+
+    if (finished) {
+        free_thread(thread);
+    }
 }
 
 intptr_t libqu_wait_thread(libqu_thread *thread)
@@ -135,6 +171,8 @@ intptr_t libqu_wait_thread(libqu_thread *thread)
         libqu_error("Failed to join thread \'%s\', error code: %d.\n", thread->name, error);
     }
 
+    free_thread(thread);
+
     return (intptr_t) retval;
 }
 
@@ -181,6 +219,50 @@ void libqu_unlock_mutex(libqu_mutex *mutex)
     pthread_mutex_unlock(&mutex->id);
 }
 
+libqu_cond *libqu_create_cond(void)
+{
+    libqu_cond *cond = calloc(1, sizeof(libqu_cond));
+
+    if (!cond) {
+        return NULL;
+    }
+
+    int error = pthread_cond_init(&cond->id, NULL);
+
+    if (error) {
+        libqu_error("Failed to create condition variable, error code: %d.\n", error);
+        free(cond);
+        return NULL;
+    }
+
+    return cond;
+}
+
+void libqu_destroy_cond(libqu_cond *cond)
+{
+    if (!cond) {
+        return;
+    }
+
+    int error = pthread_cond_destroy(&cond->id);
+
+    if (error) {
+        libqu_error("Failed to destroy condition variable, error code: %d.\n", error);
+    }
+
+    free(cond);
+}
+
+void libqu_wait_cond(libqu_cond *cond, libqu_mutex *mutex)
+{
+    pthread_cond_wait(&cond->id, &mutex->id);
+}
+
+void libqu_signal_cond(libqu_cond *cond)
+{
+    pthread_cond_broadcast(&cond->id);
+}
+
 void libqu_sleep(double seconds)
 {
     uint64_t s = (uint64_t) floor(seconds);
@@ -194,3 +276,9 @@ void libqu_sleep(double seconds)
         // Wait, do nothing.
     }
 }
+
+int libqu_get_cpu_count(void)
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return (count > 0) ? (int) count : 1;
+}
@@ -26,6 +26,11 @@ struct libqu_mutex
     CRITICAL_SECTION cs;
 };
 
+struct libqu_cond
+{
+    CONDITION_VARIABLE cv;
+};
+
 //------------------------------------------------------------------------------
 
 static double      frequency_highp;
@@ -180,8 +185,39 @@ void libqu_unlock_mutex(libqu_mutex *mutex)
     LeaveCriticalSection(&mutex->cs);
 }
 
+libqu_cond *libqu_create_cond(void)
+{
+    libqu_cond *cond = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(libqu_cond));
+    InitializeConditionVariable(&cond->cv);
+
+    return cond;
+}
+
+void libqu_destroy_cond(libqu_cond *cond)
+{
+    HeapFree(GetProcessHeap(), 0, cond);
+}
+
+void libqu_wait_cond(libqu_cond *cond, libqu_mutex *mutex)
+{
+    SleepConditionVariableCS(&cond->cv, &mutex->cs, INFINITE);
+}
+
+void libqu_signal_cond(libqu_cond *cond)
+{
+    WakeAllConditionVariable(&cond->cv);
+}
+
 void libqu_sleep(double seconds)
 {
     DWORD milliseconds = (DWORD) (seconds * 1000);
     Sleep(milliseconds);
 }
+
+int libqu_get_cpu_count(void)
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+
+    return (info.dwNumberOfProcessors > 0) ? (int) info.dwNumberOfProcessors : 1;
+}
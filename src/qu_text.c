@@ -540,7 +540,7 @@ void libqu_draw_text(int32_t font_id, float x, float y, qu_color color, char con
     float x_current = x + x_offset;
     float y_current = y;
 
-    float *v = maintain_vertex_buffer(24 * length);
+    float *v = maintain_vertex_buffer(16 * length);
 
     for (unsigned int i = 0; i < length; i++) {
         // Special case for newline character.
@@ -570,12 +570,11 @@ void libqu_draw_text(int32_t font_id, float x, float y, qu_color color, char con
         float s1 = glyph->s1 / (float) font->atlas.width;
         float t1 = glyph->t1 / (float) font->atlas.height;
 
+        // Glyphs are drawn as quads, 4 vertices each.
         *v++ = x0;  *v++ = y0;  *v++ = s0;  *v++ = t0;
         *v++ = x1;  *v++ = y0;  *v++ = s1;  *v++ = t0;
         *v++ = x1;  *v++ = y1;  *v++ = s1;  *v++ = t1;
-        *v++ = x1;  *v++ = y1;  *v++ = s1;  *v++ = t1;
         *v++ = x0;  *v++ = y1;  *v++ = s0;  *v++ = t1;
-        *v++ = x0;  *v++ = y0;  *v++ = s0;  *v++ = t0;
 
         x_current += glyph->x_advance;
         y_current += glyph->y_advance;
@@ -585,7 +584,7 @@ void libqu_draw_text(int32_t font_id, float x, float y, qu_color color, char con
 
     hb_buffer_destroy(buffer);
 
-    impl.graphics->draw_text(font->atlas.texture_id, color, impl.vertex_buffer, 6 * quad_count);
+    impl.graphics->draw_text(font->atlas.texture_id, color, impl.vertex_buffer, 4 * quad_count);
 }
 
 //------------------------------------------------------------------------------